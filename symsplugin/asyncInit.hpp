@@ -0,0 +1,119 @@
+// Field initialization on a background thread: start() returns a ticket at
+// once, the job reports its stage, and finish() returns the result. While the
+// job runs, GiNaC and the field globals belong to it
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <functional>
+
+
+enum InitStage {
+	INIT_IDLE, INIT_PARSE, INIT_DERIVATIVES, INIT_COMPILE, INIT_EQUATIONS,
+	INIT_DONE, INIT_STAGES
+};
+
+
+inline const char *initStageName(InitStage stage) {
+
+	static const char *names[INIT_STAGES] = {"idle", "parse", "derivatives",
+		"compile", "equations", "done"};
+	return names[stage];
+}
+
+
+class AsyncInit {
+
+	private:
+		std::thread worker;
+		std::atomic<int> stage{INIT_IDLE};
+		std::atomic<double> stageDone{0};	// fraction of the stage
+		std::atomic<bool> running{false};	// while the job runs
+		std::atomic<bool> jobDone{false};
+		bool collected = true;				// finish() called for the job
+		bool result = false;
+		int ticket = 0;
+
+	public:
+
+		~AsyncInit() {
+			wait();
+		}
+
+		// A new ticket, or -1 if a job is running
+		int start(const std::function<bool(void)> &job) {
+			if (running) {
+				return -1;
+			}
+			wait();
+			running = true;
+			jobDone = false;
+			collected = false;
+			stage = INIT_PARSE;
+			stageDone = 0;
+			worker = std::thread([this, job]() {
+				result = job();
+				stageDone = 0;
+				stage = INIT_DONE;
+				jobDone = true;
+				running = false;
+			});
+			return ++ticket;
+		}
+
+		// Ignored out of a job, e.g. by a synchronous initialization
+		void setStage(InitStage s) {
+			if (running) {
+				stage = s;
+				stageDone = 0;
+			}
+		}
+
+		// Fraction 0..1 of the current stage
+		void setStageProgress(double fraction) {
+			if (running) {
+				stageDone = fraction;
+			}
+		}
+
+		InitStage getStage(void) const {
+			return (InitStage)stage.load();
+		}
+
+		// Overall, 0..1
+		double getProgress(void) const {
+			return (stage - INIT_PARSE + stageDone) / (INIT_DONE - INIT_PARSE);
+		}
+
+		// The job owns the field until it returns
+		bool isRunning(void) const {
+			return running;
+		}
+
+		// Finished, and finish() not called yet
+		bool isPending(void) const {
+			return jobDone && !collected;
+		}
+
+		bool isCurrent(int t) const {
+			return t == ticket && t > 0;
+		}
+
+		bool isFinished(int t) const {
+			return isCurrent(t) && jobDone;
+		}
+
+		// The result of the finished job
+		bool finish(void) {
+			wait();
+			collected = true;
+			return result;
+		}
+
+		void wait(void) {
+			if (worker.joinable()) {
+				worker.join();
+			}
+		}
+};
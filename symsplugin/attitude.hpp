@@ -0,0 +1,183 @@
+// Attitude in doubles: rotation matrices, quaternions (V-REP order x, y, z,
+// w) and V-REP pose matrices. Euler angles only for the old interfaces
+
+#pragma once
+
+#include <cmath>
+
+
+struct Mat3 {
+	double m[3][3];
+
+	double& operator()(unsigned r, unsigned c) {
+		return m[r][c];
+	}
+	double operator()(unsigned r, unsigned c) const {
+		return m[r][c];
+	}
+};
+
+
+struct Quat {
+	double x, y, z, w;
+};
+
+
+inline Mat3 operator*(const Mat3 &a, const Mat3 &b) {
+
+	Mat3 p;
+	for (unsigned r = 0; r < 3; ++r) {
+		for (unsigned c = 0; c < 3; ++c) {
+			p.m[r][c] = a.m[r][0]*b.m[0][c] + a.m[r][1]*b.m[1][c] + a.m[r][2]*b.m[2][c];
+		}
+	}
+	return p;
+}
+
+
+// out = m * v
+inline void mulVec(const Mat3 &m, const double v[3], double out[3]) {
+
+	for (unsigned r = 0; r < 3; ++r) {
+		out[r] = m.m[r][0]*v[0] + m.m[r][1]*v[1] + m.m[r][2]*v[2];
+	}
+}
+
+
+inline Mat3 transpose(const Mat3 &a) {
+
+	Mat3 t;
+	for (unsigned r = 0; r < 3; ++r) {
+		for (unsigned c = 0; c < 3; ++c) {
+			t.m[r][c] = a.m[c][r];
+		}
+	}
+	return t;
+}
+
+
+// Same rotation in the other axis convention (paper <-> vrep), as
+//	matrixVrepTransform(): diag(1,-1,-1) * R * diag(1,-1,-1)
+inline Mat3 vrepTransform(const Mat3 &a) {
+
+	const double p[3] = {1, -1, -1};
+	Mat3 t;
+	for (unsigned r = 0; r < 3; ++r) {
+		for (unsigned c = 0; c < 3; ++c) {
+			t.m[r][c] = p[r] * p[c] * a.m[r][c];
+		}
+	}
+	return t;
+}
+
+
+// As rpy2matrix(): Rz(psi) * Ry(theta) * Rx(phi)
+inline Mat3 rpy2mat(double phi, double theta, double psi) {
+
+	double cr = cos(phi), sr = sin(phi);
+	double cp = cos(theta), sp = sin(theta);
+	double cy = cos(psi), sy = sin(psi);
+
+	return Mat3{{
+		{cy*cp, cy*sp*sr - sy*cr, cy*sp*cr + sy*sr},
+		{sy*cp, sy*sp*sr + cy*cr, sy*sp*cr - cy*sr},
+		{-sp, cp*sr, cp*cr}}};
+}
+
+
+// As abg2matrix(): Rx(a) * Ry(b) * Rz(g)
+inline Mat3 abg2mat(double a, double b, double g) {
+
+	double ca = cos(a), sa = sin(a);
+	double cb = cos(b), sb = sin(b);
+	double cg = cos(g), sg = sin(g);
+
+	return Mat3{{
+		{cb*cg, -cb*sg, sb},
+		{ca*sg + sa*sb*cg, ca*cg - sa*sb*sg, -sa*cb},
+		{sa*sg - ca*sb*cg, sa*cg + ca*sb*sg, ca*cb}}};
+}
+
+
+// As matrix2abg()
+inline void mat2abg(const Mat3 &m, double abg[3]) {
+
+	abg[0] = atan2(-m.m[1][2], m.m[2][2]);
+	abg[1] = atan2(m.m[0][2], sqrt(m.m[0][1]*m.m[0][1] + m.m[0][0]*m.m[0][0]));
+	abg[2] = atan2(-m.m[0][1], m.m[0][0]);
+}
+
+
+inline Mat3 quat2mat(const Quat &q) {
+
+	double n = q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w;
+	double s = (n > 0) ? 2 / n : 0;
+	double xx = s*q.x*q.x, yy = s*q.y*q.y, zz = s*q.z*q.z;
+	double xy = s*q.x*q.y, xz = s*q.x*q.z, yz = s*q.y*q.z;
+	double wx = s*q.w*q.x, wy = s*q.w*q.y, wz = s*q.w*q.z;
+
+	return Mat3{{
+		{1 - yy - zz, xy - wz, xz + wy},
+		{xy + wz, 1 - xx - zz, yz - wx},
+		{xz - wy, yz + wx, 1 - xx - yy}}};
+}
+
+
+inline Quat mat2quat(const Mat3 &m) {
+
+	// Largest diagonal element first, for numerical stability
+	Quat q;
+	double tr = m.m[0][0] + m.m[1][1] + m.m[2][2];
+	if (tr > 0) {
+		double s = 2 * sqrt(tr + 1);
+		q.w = s / 4;
+		q.x = (m.m[2][1] - m.m[1][2]) / s;
+		q.y = (m.m[0][2] - m.m[2][0]) / s;
+		q.z = (m.m[1][0] - m.m[0][1]) / s;
+	} else if (m.m[0][0] > m.m[1][1] && m.m[0][0] > m.m[2][2]) {
+		double s = 2 * sqrt(1 + m.m[0][0] - m.m[1][1] - m.m[2][2]);
+		q.w = (m.m[2][1] - m.m[1][2]) / s;
+		q.x = s / 4;
+		q.y = (m.m[0][1] + m.m[1][0]) / s;
+		q.z = (m.m[0][2] + m.m[2][0]) / s;
+	} else if (m.m[1][1] > m.m[2][2]) {
+		double s = 2 * sqrt(1 + m.m[1][1] - m.m[0][0] - m.m[2][2]);
+		q.w = (m.m[0][2] - m.m[2][0]) / s;
+		q.x = (m.m[0][1] + m.m[1][0]) / s;
+		q.y = s / 4;
+		q.z = (m.m[1][2] + m.m[2][1]) / s;
+	} else {
+		double s = 2 * sqrt(1 + m.m[2][2] - m.m[0][0] - m.m[1][1]);
+		q.w = (m.m[1][0] - m.m[0][1]) / s;
+		q.x = (m.m[0][2] + m.m[2][0]) / s;
+		q.y = (m.m[1][2] + m.m[2][1]) / s;
+		q.z = s / 4;
+	}
+	return q;
+}
+
+
+// V-REP pose matrices: 3x4 row-major, rotation and translation
+template <class T>
+inline Mat3 vrepPose2mat(const T f[12], double pos[3]) {
+
+	Mat3 m;
+	for (unsigned r = 0; r < 3; ++r) {
+		for (unsigned c = 0; c < 3; ++c) {
+			m.m[r][c] = f[r*4+c];
+		}
+		pos[r] = f[r*4+3];
+	}
+	return m;
+}
+
+template <class T>
+inline void mat2vrepPose(const Mat3 &m, const double pos[3], T f[12]) {
+
+	for (unsigned r = 0; r < 3; ++r) {
+		for (unsigned c = 0; c < 3; ++c) {
+			f[r*4+c] = m.m[r][c];
+		}
+		f[r*4+3] = pos[r];
+	}
+}
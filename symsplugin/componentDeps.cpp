@@ -0,0 +1,59 @@
+
+#include <sstream>
+#include "componentDeps.hpp"
+
+using namespace GiNaC;
+using std::vector;
+
+
+void ComponentDeps::analyze(const vector<const matrix*> &orders,
+		const vector<symbol> &vars) {
+
+	clear();
+	for (unsigned k = 0; k < 4; ++k) {
+		for (unsigned i = 0; i < 4; ++i) {
+			const ex &e = (*orders[k])(i,0);
+			mask[k][i] = 0;
+			for (unsigned j = 0; j < 4; ++j) {
+				if (e.has(vars[j])) {
+					mask[k][i] |= 1u << j;
+				}
+			}
+			constant[k][i] = (mask[k][i] == 0);
+			valid[k][i] = false;
+			if (constant[k][i]) {
+				value[k][i] = e.evalf();
+			}
+		}
+	}
+	analyzed = true;
+}
+
+
+std::string ComponentDeps::summary(void) const {
+
+	if (!analyzed) {
+		return "none";
+	}
+
+	const char names[] = "xyzw";
+	std::ostringstream os;
+	unsigned nConstant = 0;
+	for (unsigned k = 0; k < 4; ++k) {
+		os << (k ? " | D" : "D") << k+1 << ":";
+		for (unsigned i = 0; i < 4; ++i) {
+			os << " ";
+			if (constant[k][i]) {
+				os << "c";
+				++nConstant;
+			}
+			for (unsigned j = 0; j < 4; ++j) {
+				if (mask[k][i] & (1u << j)) {
+					os << names[j];
+				}
+			}
+		}
+	}
+	os << ", constant: " << nConstant;
+	return os.str();
+}
@@ -0,0 +1,86 @@
+// Flat outputs (x, y, z, yaw) each component of the symbolic D1..D4 depends
+// on, found at init. Constant components are folded, and a component is
+// substituted again only when one of its flat outputs changes
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ginac/ginac.h>
+
+
+class ComponentDeps {
+
+	private:
+		bool analyzed = false;
+		unsigned mask[4][4];			// [order][component], bit j: flat output j
+		bool constant[4][4];
+		GiNaC::ex value[4][4];			// folded, or of the last evaluation
+		double inputs[4][4][4];			// flat outputs of the last evaluation
+		bool valid[4][4];
+
+		unsigned long long reused = 0;
+		unsigned long long evaluated = 0;
+
+		bool fresh(unsigned k, unsigned i, const double s[4]) const {
+			if (constant[k][i]) {
+				return true;
+			}
+			if (!valid[k][i]) {
+				return false;
+			}
+			for (unsigned j = 0; j < 4; ++j) {
+				if ((mask[k][i] & (1u << j)) && inputs[k][i][j] != s[j]) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+	public:
+
+		// orders: 4 x 1 matrices D1..D4; vars: x, y, z, yaw
+		void analyze(const std::vector<const GiNaC::matrix*> &orders,
+				const std::vector<GiNaC::symbol> &vars);
+
+		void clear(void) {
+			analyzed = false;
+			reused = 0;
+			evaluated = 0;
+		}
+
+		// The component i of D(k+1) at s: eval() if its flat outputs changed
+		template <class Eval>
+		GiNaC::ex get(unsigned k, unsigned i, const double s[4], Eval eval) {
+
+			if (!analyzed) {
+				return eval();
+			}
+			if (fresh(k, i, s)) {
+				++reused;
+				return value[k][i];
+			}
+			++evaluated;
+			value[k][i] = eval();
+			for (unsigned j = 0; j < 4; ++j) {
+				inputs[k][i][j] = s[j];
+			}
+			valid[k][i] = true;
+			return value[k][i];
+		}
+
+		unsigned dependencies(unsigned k, unsigned i) const {
+			return mask[k][i];
+		}
+
+		// E.g. "D1: xy xy z w | D2: ..., constant: 2"; 'c' for constants
+		std::string summary(void) const;
+
+		unsigned long long getReused(void) const {
+			return reused;
+		}
+
+		unsigned long long getEvaluated(void) const {
+			return evaluated;
+		}
+};
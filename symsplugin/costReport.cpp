@@ -0,0 +1,84 @@
+
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include "costReport.hpp"
+
+using namespace GiNaC;
+
+
+typedef std::unordered_map<ex, OpCounts, ex_hash, ex_is_equal> OpMemo;
+
+
+// Shared subtrees are counted once per use, but visited once: the memo is by
+//	structure, since op() of a sum or product may return a temporary
+static OpCounts countOps(const ex &e, OpMemo &seen) {
+
+	auto found = seen.find(e);
+	if (found != seen.end()) {
+		return found->second;
+	}
+
+	OpCounts c;
+	size_t n = e.nops();
+	if (is_a<add>(e)) {
+		c.adds = n - 1;
+	} else if (is_a<mul>(e)) {
+		c.muls = n - 1;
+	} else if (is_a<power>(e)) {
+		const ex &expo = e.op(1);
+		if (is_a<numeric>(expo) && ex_to<numeric>(expo).is_pos_integer()) {
+			c.muls = ex_to<numeric>(expo).to_double() - 1;
+		} else {
+			c.pows = 1;
+		}
+	} else if (is_a<GiNaC::function>(e)) {
+		c.calls = 1;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		c.add(countOps(e.op(i), seen));
+	}
+	seen.emplace(e, c);
+	return c;
+}
+
+
+OpCounts countOps(const ex &e) {
+
+	OpMemo seen;
+	return countOps(e, seen);
+}
+
+
+std::string formatCostReport(const OpCounts ops[4][4], double stepMicros,
+		const std::string &backend, bool symbolic) {
+
+	std::ostringstream os;
+	os << std::setprecision(6);
+	os << "Operations (adds, muls, pows, calls) per component:" << std::endl;
+	OpCounts all;
+	for (unsigned k = 0; k < 4; ++k) {
+		OpCounts order;
+		os << "  D" << k+1 << ":";
+		for (unsigned i = 0; i < 4; ++i) {
+			const OpCounts &c = ops[k][i];
+			os << "  [" << c.adds << ", " << c.muls << ", " << c.pows << ", " <<
+				c.calls << "]";
+			order.add(c);
+		}
+		os << "  total " << order.total() << std::endl;
+		all.add(order);
+	}
+	os << "  all: " << all.adds << " adds, " << all.muls << " muls, " << all.pows <<
+		" pows, " << all.calls << " calls" << std::endl;
+	if (stepMicros <= 0) {
+		os << "Step: not measured" << std::endl;
+		return os.str();
+	}
+	os << "Step: " << stepMicros << " us measured (" << backend << ")";
+	if (symbolic && all.total() > 0) {
+		os << ", " << stepMicros * 1000 / all.total() << " ns per symbolic operation";
+	}
+	os << std::endl;
+	return os.str();
+}
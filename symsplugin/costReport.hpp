@@ -0,0 +1,36 @@
+// Cost of a field: the operations of each component of D1..D4 (additions,
+// multiplications, powers, function calls, as a substitution evaluates
+// them) and, measured on request, the time of a step with its backends
+
+#pragma once
+
+#include <string>
+#include <ginac/ginac.h>
+
+
+struct OpCounts {
+	double adds = 0;
+	double muls = 0;
+	double pows = 0;		// non-integer or negative exponents included
+	double calls = 0;		// sin, cos, exp, log, ...
+
+	void add(const OpCounts &o) {
+		adds += o.adds;
+		muls += o.muls;
+		pows += o.pows;
+		calls += o.calls;
+	}
+
+	double total(void) const {
+		return adds + muls + pows + calls;
+	}
+};
+
+
+OpCounts countOps(const GiNaC::ex &e);
+
+// ops[k][i]: component i of D(k+1); stepMicros: measured time of a step, 0
+//	if not measured; symbolic: the derivatives are substituted, so the time
+//	per operation is reported
+std::string formatCostReport(const OpCounts ops[4][4], double stepMicros,
+		const std::string &backend, bool symbolic);
@@ -0,0 +1,67 @@
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <iomanip>
+#include "crossCheck.hpp"
+
+using std::vector;
+
+
+void ErrorStats::add(const double *values, const double *reference, unsigned n,
+		const double pose[4]) {
+
+	double err = 0;
+	for (unsigned i = 0; i < n; ++i) {
+		bool nanV = std::isnan(values[i]), nanR = std::isnan(reference[i]);
+		if (nanV || nanR) {
+			if (nanV != nanR) {
+				err = std::numeric_limits<double>::infinity();
+			}
+			continue;
+		}
+		err = std::max(err, std::fabs(values[i] - reference[i]) /
+				(1 + std::fabs(reference[i])));
+	}
+
+	if (errors.empty() || err > maxErr) {
+		std::copy(pose, pose+4, worstPose);
+		maxErr = err;
+	}
+	errors.push_back(err);
+}
+
+
+// Nearest rank
+double ErrorStats::percentile(double p) const {
+
+	if (errors.empty()) {
+		return 0;
+	}
+	vector<double> sorted(errors);
+	unsigned k = std::min<unsigned>(sorted.size() - 1, p * sorted.size());
+	std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+	return sorted[k];
+}
+
+
+void ErrorStats::report(std::ostream &os) const {
+
+	double mean = 0;
+	for (double e : errors) {
+		mean += e;
+	}
+	mean = errors.empty() ? 0 : mean / errors.size();
+
+	std::ios_base::fmtflags flags = os.flags();
+	os << std::left << std::setw(22) << name << std::right << std::scientific <<
+		std::setprecision(2) << " n " << errors.size() << "  mean " << mean <<
+		"  p50 " << percentile(0.5) << "  p99 " << percentile(0.99) <<
+		"  max " << maxError();
+	if (!errors.empty()) {
+		os << std::fixed << std::setprecision(4) << "  at (" << worstPose[0] <<
+			", " << worstPose[1] << ", " << worstPose[2] << ", " << worstPose[3] << ")";
+	}
+	os << (passed() ? "  ok" : "  FAILED") << std::endl;
+	os.flags(flags);
+}
@@ -0,0 +1,42 @@
+// Error distribution of a backend against the reference: per sample, the
+// max over the components of |value - reference| / (1 + |reference|)
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+
+class ErrorStats {
+
+	private:
+		std::string name;
+		double tolerance;
+
+		std::vector<double> errors;
+		double maxErr = 0;
+		double worstPose[4];
+
+		double percentile(double p) const;
+
+	public:
+
+		ErrorStats(const std::string &name, double tolerance):
+			name(name), tolerance(tolerance) {}
+
+		// A NaN on one side only is an infinite error
+		void add(const double *values, const double *reference, unsigned n,
+				const double pose[4]);
+
+		double maxError(void) const {
+			return maxErr;
+		}
+
+		bool passed(void) const {
+			return maxError() <= tolerance;
+		}
+
+		// One line: name, samples, mean, p50, p99, max, worst pose, result
+		void report(std::ostream &os) const;
+};
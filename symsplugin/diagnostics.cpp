@@ -0,0 +1,113 @@
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <map>
+#include "diagnostics.hpp"
+
+
+// Function static: used by global constructors
+static const std::map<std::string, unsigned>& channelNames(void) {
+
+	static const std::map<std::string, unsigned> names = {
+		{"init", DIAG_INIT},
+		{"flatOutputs", DIAG_FLAT_OUTPUTS},
+		{"inputs", DIAG_INPUTS},
+		{"integration", DIAG_INTEGRATION},
+		{"setIntegration", DIAG_SET_INTEGRATION | DIAG_INTEGRATION},
+		{"all", DIAG_INIT | DIAG_FLAT_OUTPUTS | DIAG_INPUTS | DIAG_INTEGRATION},
+	};
+	return names;
+}
+
+
+Diagnostics::Diagnostics(): mask(0) {
+
+	const char *env = getenv("FIELDFOLLOW_DIAG");
+	if (env) {
+		setChannels(env);
+	}
+}
+
+
+bool Diagnostics::setChannels(const std::string &names) {
+
+	unsigned newMask = 0;
+	bool ok = true;
+
+	std::istringstream is(names);
+	std::string name;
+	while (getline(is, name, ',')) {
+		if (name.empty()) {
+			continue;
+		}
+		auto ch = channelNames().find(name);
+		if (ch == channelNames().end()) {
+			std::cerr << "Diagnostics: unknown channel " << name << std::endl;
+			ok = false;
+		} else {
+			newMask |= ch->second;
+		}
+	}
+
+	mask.store(newMask);
+	return ok;
+}
+
+
+void Diagnostics::write(const std::string &msg) {
+
+	std::lock_guard<std::mutex> lock(queueMutex);
+
+	if (!writerRunning) {
+		stopping = false;
+		writerRunning = true;
+		writer = std::thread(&Diagnostics::writerLoop, this);
+	}
+
+	queue.push_back(msg);
+	queueCond.notify_one();
+}
+
+
+void Diagnostics::writerLoop(void) {
+
+	std::unique_lock<std::mutex> lock(queueMutex);
+	for (;;) {
+		queueCond.wait(lock, [this] { return stopping || !queue.empty(); });
+
+		std::deque<std::string> pending;
+		pending.swap(queue);
+		bool last = stopping;
+
+		// print without holding the lock
+		lock.unlock();
+		for (const std::string &msg : pending) {
+			std::cout << msg;
+		}
+		std::cout << std::flush;
+		lock.lock();
+
+		if (last && queue.empty()) {
+			return;
+		}
+	}
+}
+
+
+void Diagnostics::stop(void) {
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		if (!writerRunning) {
+			return;
+		}
+		stopping = true;
+		queueCond.notify_one();
+	}
+
+	writer.join();
+
+	std::lock_guard<std::mutex> lock(queueMutex);
+	writerRunning = false;
+}
@@ -0,0 +1,61 @@
+// Diagnostic channels selectable at runtime, also with the FIELDFOLLOW_DIAG
+// environment variable. A disabled channel costs a relaxed atomic load; the
+// messages of enabled ones are printed by a background thread
+
+#pragma once
+
+#include <string>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+
+enum DiagChannel {
+	DIAG_INIT = 1,				// "init": initial state set in the scene
+	DIAG_FLAT_OUTPUTS = 2,		// "flatOutputs": flat outputs and derivatives
+	DIAG_INPUTS = 4,			// "inputs": feed-forward inputs and feedback gains
+	DIAG_INTEGRATION = 8,		// "integration": integration cross-check
+	DIAG_SET_INTEGRATION = 16,	// "setIntegration": also moves the shape, motors off
+};
+
+
+class Diagnostics {
+
+	private:
+		std::atomic<unsigned> mask;
+
+		std::mutex queueMutex;
+		std::condition_variable queueCond;
+		std::deque<std::string> queue;
+		std::thread writer;
+		bool writerRunning = false;
+		bool stopping = false;
+
+		void writerLoop(void);
+
+	public:
+
+		Diagnostics();
+		~Diagnostics() {
+			stop();
+		}
+
+		// Comma separated channel names, "all" or "". False on unknown names
+		bool setChannels(const std::string &names);
+
+		unsigned getChannels(void) const {
+			return mask.load(std::memory_order_relaxed);
+		}
+
+		bool on(unsigned channels) const {
+			return (mask.load(std::memory_order_relaxed) & channels) != 0;
+		}
+
+		// Queue a message for printing (newline not added)
+		void write(const std::string &msg);
+
+		// Print the pending messages and stop the writer thread
+		void stop(void);
+};
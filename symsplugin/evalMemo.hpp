@@ -0,0 +1,87 @@
+// Memo of the last evaluations of the field. The desired state and inputs
+// depend only on the flat outputs (paper convention), so a query at the same
+// flat outputs, e.g. update and updateFeedback in one step, is a copy
+
+#pragma once
+
+#include <algorithm>
+
+
+template <class S, class I>
+class EvalMemo {
+
+	public:
+
+		enum { CAPACITY = 8 };
+
+		struct Entry {
+			double s[4];		// flat outputs
+			double d[4][4];		// their derivatives 1..4
+			S state;
+			I inputs;
+		};
+
+	private:
+
+		Entry entries[CAPACITY];
+		unsigned size = 4;		// entries in use, <= CAPACITY
+		unsigned count = 0;		// valid entries
+		unsigned next = 0;		// next slot to overwrite
+
+		unsigned long long hits = 0;
+		unsigned long long misses = 0;
+
+	public:
+
+		// Number of entries, 0 disables
+		void configure(unsigned newSize) {
+			size = std::min(newSize, (unsigned)CAPACITY);
+			clear();
+		}
+
+		void clear(void) {
+			count = 0;
+			next = 0;
+		}
+
+		// Most recent entry at exactly s, or NULL: a near entry would return
+		//	the state and inputs of another pose
+		const Entry* find(const double s[4]) {
+
+			for (unsigned k = 1; k <= count; ++k) {
+				const Entry &e = entries[(next + size - k) % size];
+				if (std::equal(s, s+4, e.s)) {
+					++hits;
+					return &e;
+				}
+			}
+
+			++misses;
+			return NULL;
+		}
+
+		void store(const double s[4], const double d[4][4], const S &state,
+				const I &inputs) {
+
+			if (size == 0) {
+				return;
+			}
+
+			Entry &e = entries[next];
+			std::copy(s, s+4, e.s);
+			std::copy(&d[0][0], &d[0][0]+16, &e.d[0][0]);
+			e.state = state;
+			e.inputs = inputs;
+
+			next = (next + 1) % size;
+			count = std::min(count + 1, size);
+		}
+
+		unsigned long long getHits(void) const {
+			return hits;
+		}
+
+		unsigned long long getMisses(void) const {
+			return misses;
+		}
+};
@@ -0,0 +1,89 @@
+
+#include <sstream>
+#include <algorithm>
+#include "exprProfile.hpp"
+
+using namespace GiNaC;
+using std::vector;
+
+
+// Rough size of an object: the object itself, and a reference (and a
+//	coefficient, in sums and products) per operand
+static const size_t NODE_BYTES = 64;
+static const size_t OPERAND_BYTES = 16;
+
+
+namespace {
+
+struct NodeInfo {
+	double nodes;
+	unsigned depth;
+	ex object;		// keeps the address in use: op() of a sum or product may
+					//	return a temporary
+};
+
+class Profiler {
+
+	private:
+		std::unordered_map<const basic*, NodeInfo> seen;
+
+	public:
+		ExprStats stats;
+
+		NodeInfo visit(const ex &e) {
+
+			const basic *object = &ex_to<basic>(e);
+			auto found = seen.find(object);
+			if (found != seen.end()) {
+				return found->second;
+			}
+
+			NodeInfo info = {1, 1, e};
+			for (size_t i = 0; i < e.nops(); ++i) {
+				NodeInfo child = visit(e.op(i));
+				info.nodes += child.nodes;
+				info.depth = std::max(info.depth, child.depth + 1);
+			}
+			seen.emplace(object, info);
+			++stats.unique;
+			stats.bytes += NODE_BYTES + OPERAND_BYTES * e.nops();
+			return info;
+		}
+};
+
+}
+
+
+ExprStats profileExpressions(const vector<ex> &exprs) {
+
+	Profiler profiler;
+	for (const ex &e : exprs) {
+		NodeInfo info = profiler.visit(e);
+		profiler.stats.nodes += info.nodes;
+		profiler.stats.depth = std::max(profiler.stats.depth, info.depth);
+	}
+	return profiler.stats;
+}
+
+
+std::string formatExprStats(const ExprStats &stats) {
+
+	std::ostringstream os;
+	os << stats.nodes << " nodes, " << stats.unique << " unique, depth " <<
+		stats.depth << ", ~" << (stats.bytes + 512) / 1024 << " KiB";
+	return os.str();
+}
+
+
+ex ExprCompactor::compact(const ex &e) {
+
+	auto found = table.find(e);
+	if (found != table.end()) {
+		return found->second;
+	}
+
+	// Operands first: map() makes a copy only if one of them changed
+	ex canonical = (e.nops() == 0) ? e : e.map(*this);
+	table.emplace(canonical, canonical);
+	return canonical;
+}
@@ -0,0 +1,50 @@
+// Memory profile of GiNaC expressions: nodes as a tree, distinct objects,
+// depth and approximate bytes. Equal subtrees built separately (e.g. by
+// differentiation) are distinct objects; the compactor rebuilds expressions
+// so that they are one object (hash-consing), across all it is given
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <ginac/ginac.h>
+
+
+struct ExprStats {
+	double nodes = 0;			// as a tree: shared subtrees counted each time
+	size_t unique = 0;			// distinct objects
+	unsigned depth = 0;
+	size_t bytes = 0;			// approximate, of the distinct objects
+};
+
+
+// The expressions together: an object shared between them is counted once
+ExprStats profileExpressions(const std::vector<GiNaC::ex> &exprs);
+
+std::string formatExprStats(const ExprStats &stats);
+
+
+class ExprCompactor : public GiNaC::map_function {
+
+	private:
+		// Canonical object of each subtree, by structure
+		std::unordered_map<GiNaC::ex, GiNaC::ex, GiNaC::ex_hash, GiNaC::ex_is_equal> table;
+
+	public:
+
+		// An equal expression, whose subtrees are the canonical ones
+		GiNaC::ex compact(const GiNaC::ex &e);
+
+		GiNaC::ex operator()(const GiNaC::ex &e) override {
+			return compact(e);
+		}
+
+		size_t size(void) const {
+			return table.size();
+		}
+
+		void clear(void) {
+			table.clear();
+		}
+};
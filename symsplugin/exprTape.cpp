@@ -0,0 +1,213 @@
+
+#include <cmath>
+#include <map>
+#include <algorithm>
+#include <string>
+#include "exprTape.hpp"
+
+using namespace GiNaC;
+using std::string;
+using std::vector;
+
+
+// GiNaC function name -> unary operation
+static const std::map<string, ExprTape::Op>& unaryOps(void) {
+
+	static const std::map<string, ExprTape::Op> ops = {
+		{"sin", ExprTape::OP_SIN}, {"cos", ExprTape::OP_COS}, {"tan", ExprTape::OP_TAN},
+		{"asin", ExprTape::OP_ASIN}, {"acos", ExprTape::OP_ACOS}, {"atan", ExprTape::OP_ATAN},
+		{"sinh", ExprTape::OP_SINH}, {"cosh", ExprTape::OP_COSH}, {"tanh", ExprTape::OP_TANH},
+		{"exp", ExprTape::OP_EXP}, {"log", ExprTape::OP_LOG}, {"abs", ExprTape::OP_ABS},
+	};
+	return ops;
+}
+
+
+int ExprTape::push(Op op, int a, int b, double c) {
+
+	nodes.push_back(Node{op, a, b, c});
+	return nodes.size() - 1;
+}
+
+
+// Node index of e, -1 if not supported
+int ExprTape::emit(const ex &e) {
+
+	auto found = compiled.find(e);
+	if (found != compiled.end()) {
+		return found->second;
+	}
+
+	int node = -1;
+	int index = leafIndex(e);
+
+	if (index >= 0) {
+		node = push(OP_IN, index, -1, 0);
+		nInputs = std::max(nInputs, (unsigned)index + 1);
+
+	} else if (is_a<numeric>(e) || is_a<constant>(e)) {
+		ex v = e.evalf();
+		if (is_a<numeric>(v) && ex_to<numeric>(v).is_real()) {
+			node = push(OP_CONST, -1, -1, ex_to<numeric>(v).to_double());
+		}
+
+	} else if (is_a<add>(e) || is_a<mul>(e)) {
+		Op op = is_a<add>(e) ? OP_ADD : OP_MUL;
+		node = emit(e.op(0));
+		for (size_t i = 1; i < e.nops() && node >= 0; ++i) {
+			int arg = emit(e.op(i));
+			node = (arg < 0) ? -1 : push(op, node, arg, 0);
+		}
+
+	} else if (is_a<power>(e)) {
+		int base = emit(e.op(0));
+		const ex &expo = e.op(1);
+		if (base < 0) {
+			node = -1;
+		} else if (is_a<numeric>(expo) && ex_to<numeric>(expo).is_integer()) {
+			node = push(OP_POWI, base, -1, ex_to<numeric>(expo).to_int());
+		} else if (is_a<numeric>(expo) && ex_to<numeric>(expo).is_real()) {
+			node = push(OP_POWR, base, -1, ex_to<numeric>(expo).to_double());
+		} else {
+			// a^b = exp(b * log(a))
+			int b = emit(expo);
+			if (b >= 0) {
+				int logBase = push(OP_LOG, base, -1, 0);
+				node = push(OP_EXP, push(OP_MUL, b, logBase, 0), -1, 0);
+			}
+		}
+
+	} else if (is_a<function>(e)) {
+		string fName = ex_to<function>(e).get_name();
+		if (fName == "atan2" && e.nops() == 2) {
+			int y = emit(e.op(0));
+			int x = emit(e.op(1));
+			if (y >= 0 && x >= 0) {
+				node = push(OP_ATAN2, y, x, 0);
+			}
+		} else {
+			auto op = unaryOps().find(fName);
+			if (op != unaryOps().end() && e.nops() == 1) {
+				int a = emit(e.op(0));
+				if (a >= 0) {
+					node = push(op->second, a, -1, 0);
+				}
+			}
+		}
+	}
+
+	if (node >= 0) {
+		compiled[e] = node;
+	}
+	return node;
+}
+
+
+bool ExprTape::compile(const vector<ex> &exprs) {
+
+	nodes.clear();
+	outputs.clear();
+	compiled.clear();
+	nInputs = 0;
+
+	for (const ex &e : exprs) {
+		int node = emit(e);
+		if (node < 0) {
+			nodes.clear();
+			outputs.clear();
+			compiled.clear();
+			return false;
+		}
+		outputs.push_back(node);
+	}
+
+	compiled.clear();		// only needed while compiling
+	return true;
+}
+
+
+void ExprTape::eval(const double in[], double out[], vector<double> &work) const {
+
+	work.resize(nodes.size());
+	double *v = work.data();
+
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const Node &n = nodes[i];
+		switch (n.op) {
+			case OP_IN: v[i] = in[n.a]; break;
+			case OP_CONST: v[i] = n.c; break;
+			case OP_ADD: v[i] = v[n.a] + v[n.b]; break;
+			case OP_MUL: v[i] = v[n.a] * v[n.b]; break;
+			case OP_POWI: v[i] = std::pow(v[n.a], (int)n.c); break;
+			case OP_POWR: v[i] = std::pow(v[n.a], n.c); break;
+			case OP_SIN: v[i] = std::sin(v[n.a]); break;
+			case OP_COS: v[i] = std::cos(v[n.a]); break;
+			case OP_TAN: v[i] = std::tan(v[n.a]); break;
+			case OP_ASIN: v[i] = std::asin(v[n.a]); break;
+			case OP_ACOS: v[i] = std::acos(v[n.a]); break;
+			case OP_ATAN: v[i] = std::atan(v[n.a]); break;
+			case OP_ATAN2: v[i] = std::atan2(v[n.a], v[n.b]); break;
+			case OP_SINH: v[i] = std::sinh(v[n.a]); break;
+			case OP_COSH: v[i] = std::cosh(v[n.a]); break;
+			case OP_TANH: v[i] = std::tanh(v[n.a]); break;
+			case OP_EXP: v[i] = std::exp(v[n.a]); break;
+			case OP_LOG: v[i] = std::log(v[n.a]); break;
+			case OP_ABS: v[i] = std::fabs(v[n.a]); break;
+		}
+	}
+
+	for (size_t o = 0; o < outputs.size(); ++o) {
+		out[o] = v[outputs[o]];
+	}
+}
+
+
+void ExprTape::eval(const double in[], double out[]) const {
+
+	thread_local vector<double> work;
+	eval(in, out, work);
+}
+
+
+template <class T>
+void ExprTape::evalTaylor(const TaylorT<T> in[], TaylorT<T> out[], unsigned order,
+		vector<TaylorT<T>> &work) const {
+
+	work.resize(nodes.size());
+	TaylorT<T> *v = work.data();
+	TaylorT<T> s, c;
+
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const Node &n = nodes[i];
+		switch (n.op) {
+			case OP_IN: v[i] = in[n.a]; break;
+			case OP_CONST: tConst(n.c, v[i], order); break;
+			case OP_ADD: tAdd(v[n.a], v[n.b], v[i], order); break;
+			case OP_MUL: tMul(v[n.a], v[n.b], v[i], order); break;
+			case OP_POWI: tPowI(v[n.a], (int)n.c, v[i], order); break;
+			case OP_POWR: tPowR(v[n.a], n.c, v[i], order); break;
+			case OP_SIN: tSinCos(v[n.a], v[i], c, order); break;
+			case OP_COS: tSinCos(v[n.a], s, v[i], order); break;
+			case OP_TAN: tSinCos(v[n.a], s, c, order); tDiv(s, c, v[i], order); break;
+			case OP_ASIN: tAsin(v[n.a], v[i], order); break;
+			case OP_ACOS: tAcos(v[n.a], v[i], order); break;
+			case OP_ATAN: tAtan(v[n.a], v[i], order); break;
+			case OP_ATAN2: tAtan2(v[n.a], v[n.b], v[i], order); break;
+			case OP_SINH: tSinhCosh(v[n.a], v[i], c, order); break;
+			case OP_COSH: tSinhCosh(v[n.a], s, v[i], order); break;
+			case OP_TANH: tSinhCosh(v[n.a], s, c, order); tDiv(s, c, v[i], order); break;
+			case OP_EXP: tExp(v[n.a], v[i], order); break;
+			case OP_LOG: tLog(v[n.a], v[i], order); break;
+			case OP_ABS: tAbs(v[n.a], v[i], order); break;
+		}
+	}
+
+	for (size_t o = 0; o < outputs.size(); ++o) {
+		out[o] = v[outputs[o]];
+	}
+}
+
+template void ExprTape::evalTaylor<double>(const Taylor[], Taylor[], unsigned,
+		vector<Taylor>&) const;
+template void ExprTape::evalTaylor<float>(const TaylorF[], TaylorF[], unsigned,
+		vector<TaylorF>&) const;
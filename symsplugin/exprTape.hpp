@@ -0,0 +1,76 @@
+// Expression tape: GiNaC expressions flattened once into numeric operations,
+// shared subexpressions stored once. Read-only after compile(): threads can
+// evaluate it, each with its own work buffer, in doubles or Taylor series
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <ginac/ginac.h>
+#include "taylor.hpp"
+
+
+class ExprTape {
+
+	public:
+		// Returns the input index of a leaf (symbol or function), -1 if
+		//	the expression is not a leaf
+		typedef std::function<int(const GiNaC::ex&)> LeafMap;
+
+		enum Op {
+			OP_IN, OP_CONST, OP_ADD, OP_MUL, OP_POWI, OP_POWR,
+			OP_SIN, OP_COS, OP_TAN, OP_ASIN, OP_ACOS, OP_ATAN, OP_ATAN2,
+			OP_SINH, OP_COSH, OP_TANH, OP_EXP, OP_LOG, OP_ABS,
+		};
+
+		struct Node {
+			Op op;
+			int a, b;		// argument nodes; a is the input index for OP_IN
+			double c;		// OP_CONST value, OP_POWI/OP_POWR exponent
+		};
+
+	private:
+		LeafMap leafIndex;
+
+		std::vector<Node> nodes;		// in dependency order
+		std::vector<int> outputs;		// node of each output
+		unsigned nInputs = 0;
+
+		std::map<GiNaC::ex, int, GiNaC::ex_is_less> compiled;
+
+		int emit(const GiNaC::ex &e);
+		int push(Op op, int a, int b, double c);
+
+	public:
+
+		ExprTape(LeafMap leaf): leafIndex(leaf) {}
+
+		// Replaces the tape; false if an expression is not supported
+		bool compile(const std::vector<GiNaC::ex> &exprs);
+
+		// in: the values of the leaves; out: one value per expression
+		void eval(const double in[], double out[], std::vector<double> &work) const;
+		void eval(const double in[], double out[]) const;
+
+		// Same, on Taylor series: coefficients 0..order of the outputs.
+		//	T is double or float
+		template <class T>
+		void evalTaylor(const TaylorT<T> in[], TaylorT<T> out[], unsigned order,
+				std::vector<TaylorT<T>> &work) const;
+
+		unsigned size(void) const {
+			return nodes.size();
+		}
+
+		unsigned numInputs(void) const {
+			return nInputs;
+		}
+
+		unsigned numOutputs(void) const {
+			return outputs.size();
+		}
+
+		const std::vector<Node>& getNodes(void) const {
+			return nodes;
+		}
+};
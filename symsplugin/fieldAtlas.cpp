@@ -0,0 +1,348 @@
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include "fieldAtlas.hpp"
+
+using namespace GiNaC;
+using std::string;
+using std::vector;
+
+
+// exp(-1/u) for u > 0, else 0: all derivatives vanish at 0
+static void tPsi(const Taylor &u, Taylor &r, unsigned n) {
+
+	if (u.c[0] <= 0) {
+		tConst(0, r, n);
+		return;
+	}
+	Taylor one, inv;
+	tConst(1, one, n);
+	tDiv(one, u, inv, n);
+	tScale(inv, -1, inv, n);
+	tExp(inv, r, n);
+}
+
+
+// Smooth step: 0 for u <= 0, 1 for u >= 1
+static void tStep(const Taylor &u, Taylor &r, unsigned n) {
+
+	if (u.c[0] <= 0 || u.c[0] >= 1) {
+		tConst(u.c[0] <= 0 ? 0 : 1, r, n);
+		return;
+	}
+	Taylor oneMinus, p0, p1, sum;
+	tScale(u, -1, oneMinus, n);
+	oneMinus.c[0] += 1;
+	tPsi(u, p0, n);
+	tPsi(oneMinus, p1, n);
+	tAdd(p0, p1, sum, n);
+	tDiv(p0, sum, r, n);
+}
+
+
+// Weight of a region at S; w.c[0] is 1 in the core, 0 outside
+static void tWeight(const AtlasRegion &reg, const Taylor S[4], Taylor &w, unsigned n) {
+
+	Taylor u, f, tmp;
+
+	switch (reg.type) {
+
+		case AtlasRegion::ALL:
+			tConst(1, w, n);
+			break;
+
+		case AtlasRegion::BOX:
+			tConst(1, w, n);
+			for (unsigned i = 0; i < 3 && w.c[0] != 0; ++i) {
+				tScale(S[i], 1 / reg.margin, u, n);
+				u.c[0] -= reg.lo[i] / reg.margin;
+				tStep(u, f, n);
+				tMul(w, f, tmp, n);
+				tScale(S[i], -1 / reg.margin, u, n);
+				u.c[0] += reg.hi[i] / reg.margin;
+				tStep(u, f, n);
+				tMul(tmp, f, w, n);
+			}
+			break;
+
+		case AtlasRegion::SPHERE: {
+			// u = (r^2 - |p-c|^2) / (r^2 - (r-margin)^2): 1 at r-margin, 0 at r
+			Taylor dist2;
+			tConst(0, dist2, n);
+			for (unsigned i = 0; i < 3; ++i) {
+				Taylor diff = S[i];
+				diff.c[0] -= reg.center[i];
+				tMul(diff, diff, tmp, n);
+				tAdd(dist2, tmp, f, n);
+				dist2 = f;
+			}
+			double r2 = reg.radius * reg.radius;
+			double inner = reg.radius - reg.margin;
+			double scale = r2 - inner * inner;
+			tScale(dist2, -1 / scale, u, n);
+			u.c[0] += r2 / scale;
+			tStep(u, w, n);
+			break;
+		}
+	}
+}
+
+
+static bool readRegion(std::istream &is, AtlasRegion &reg) {
+
+	string type;
+	if (!(is >> type)) {
+		return false;
+	}
+
+	if (type == "all") {
+		reg.type = AtlasRegion::ALL;
+		reg.margin = 0;
+		return true;
+	}
+
+	if (type == "box") {
+		reg.type = AtlasRegion::BOX;
+		for (unsigned i = 0; i < 3; ++i) is >> reg.lo[i];
+		for (unsigned i = 0; i < 3; ++i) is >> reg.hi[i];
+		is >> reg.margin;
+		if (!is) {
+			return false;
+		}
+		for (unsigned i = 0; i < 3; ++i) {
+			if (reg.hi[i] - reg.lo[i] < 2 * reg.margin) {
+				return false;
+			}
+		}
+		return reg.margin > 0;
+	}
+
+	if (type == "sphere") {
+		reg.type = AtlasRegion::SPHERE;
+		for (unsigned i = 0; i < 3; ++i) is >> reg.center[i];
+		is >> reg.radius >> reg.margin;
+		if (!is) {
+			return false;
+		}
+		for (unsigned i = 0; i < 3; ++i) {
+			reg.lo[i] = reg.center[i] - reg.radius;
+			reg.hi[i] = reg.center[i] + reg.radius;
+		}
+		return reg.margin > 0 && reg.margin <= reg.radius;
+	}
+
+	return false;
+}
+
+
+// The field file: one component per line, x, y, z, w
+static bool readField(const string &path, const vector<symbol> &vars,
+		vector<ex> &field) {
+
+	std::ifstream vectFile(path);
+	if (!vectFile) {
+		return false;
+	}
+
+	symtab table;
+	const char *names[] = {"x", "y", "z", "w"};
+	for (unsigned i = 0; i < vars.size() && i < 4; ++i) {
+		table[names[i]] = vars[i];
+	}
+	parser reader(table);
+
+	field.assign(4, 0);
+	string line;
+	for (unsigned i = 0; i < 4 && getline(vectFile, line); ++i) {
+		try {
+			field[i] = reader(line);
+		} catch (std::exception &e) {
+			std::cerr << path << ": " << e.what() << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+
+bool FieldAtlas::load(const string &path, const vector<symbol> &vars) {
+
+	clear();
+
+	std::ifstream atlasFile(path);
+	if (!atlasFile) {
+		std::cerr << "Atlas: can't open " << path << std::endl;
+		return false;
+	}
+
+	size_t slash = path.find_last_of('/');
+	string dir = (slash == string::npos) ? "" : path.substr(0, slash+1);
+
+	auto leaf = [&vars](const ex &e) -> int {
+		for (unsigned i = 0; i < vars.size(); ++i) {
+			if (e.is_equal(vars[i])) {
+				return i;
+			}
+		}
+		return -1;
+	};
+
+	string line;
+	unsigned lineNo = 0;
+	while (getline(atlasFile, line)) {
+		++lineNo;
+		std::istringstream is(line);
+		string file;
+		if (!(is >> file) || file[0] == '#') {
+			continue;
+		}
+
+		Member m{file, AtlasRegion(), ExprTape(leaf)};
+		if (!readRegion(is, m.region)) {
+			std::cerr << "Atlas: bad region at line " << lineNo << std::endl;
+			clear();
+			return false;
+		}
+
+		string fieldPath = (file[0] == '/') ? file : dir + file;
+		vector<ex> field;
+		if (!readField(fieldPath, vars, field) || !m.tape.compile(field)) {
+			std::cerr << "Atlas: can't compile " << fieldPath << std::endl;
+			clear();
+			return false;
+		}
+
+		members.push_back(m);
+	}
+
+	if (members.empty()) {
+		std::cerr << "Atlas: no fields in " << path << std::endl;
+		return false;
+	}
+
+	buildIndex();
+	return true;
+}
+
+
+void FieldAtlas::buildIndex(void) {
+
+	cells.clear();
+	everywhere.clear();
+
+	// Bounding box of the bounded regions; the background is excluded
+	bool bounded = false;
+	double hi[3];
+	for (unsigned k = 1; k < members.size(); ++k) {
+		const AtlasRegion &reg = members[k].region;
+		if (reg.type == AtlasRegion::ALL) {
+			continue;
+		}
+		for (unsigned i = 0; i < 3; ++i) {
+			gridLo[i] = bounded ? std::min(gridLo[i], reg.lo[i]) : reg.lo[i];
+			hi[i] = bounded ? std::max(hi[i], reg.hi[i]) : reg.hi[i];
+		}
+		bounded = true;
+	}
+	if (!bounded) {
+		for (unsigned k = 1; k < members.size(); ++k) {
+			everywhere.push_back(k);
+		}
+		return;
+	}
+
+	for (unsigned i = 0; i < 3; ++i) {
+		gridCell[i] = std::max(hi[i] - gridLo[i], 1e-9) / GRID_N;
+	}
+
+	cells.assign(GRID_N * GRID_N * GRID_N, vector<unsigned>());
+	for (unsigned k = 1; k < members.size(); ++k) {
+		const AtlasRegion &reg = members[k].region;
+		if (reg.type == AtlasRegion::ALL) {
+			everywhere.push_back(k);
+			for (vector<unsigned> &cell : cells) {
+				cell.push_back(k);
+			}
+			continue;
+		}
+
+		unsigned from[3], to[3];
+		for (unsigned i = 0; i < 3; ++i) {
+			from[i] = std::min<unsigned>((reg.lo[i] - gridLo[i]) / gridCell[i], GRID_N-1);
+			to[i] = std::min<unsigned>((reg.hi[i] - gridLo[i]) / gridCell[i], GRID_N-1);
+		}
+		for (unsigned a = from[0]; a <= to[0]; ++a) {
+			for (unsigned b = from[1]; b <= to[1]; ++b) {
+				for (unsigned c = from[2]; c <= to[2]; ++c) {
+					cells[(a * GRID_N + b) * GRID_N + c].push_back(k);
+				}
+			}
+		}
+	}
+}
+
+
+const vector<unsigned>& FieldAtlas::candidates(const double s[4]) const {
+
+	if (cells.empty()) {
+		return everywhere;
+	}
+
+	unsigned idx[3];
+	for (unsigned i = 0; i < 3; ++i) {
+		double cell = std::floor((s[i] - gridLo[i]) / gridCell[i]);
+		if (cell < 0 || cell >= GRID_N) {
+			return everywhere;
+		}
+		idx[i] = cell;
+	}
+	return cells[(idx[0] * GRID_N + idx[1]) * GRID_N + idx[2]];
+}
+
+
+void FieldAtlas::blend(const vector<unsigned> &cand, const Taylor S[4],
+		Taylor V[4], unsigned order) const {
+
+	thread_local vector<Taylor> work;
+	thread_local vector<Taylor> w;
+
+	// Weights; the fields below a core region are hidden
+	w.resize(cand.size());
+	unsigned base = 0, first = 0;
+	for (unsigned j = 0; j < cand.size(); ++j) {
+		tWeight(members[cand[j]].region, S, w[j], order);
+		if (w[j].c[0] == 1) {
+			base = cand[j];
+			first = j + 1;
+		}
+	}
+
+	members[base].tape.evalTaylor(S, V, order, work);
+
+	Taylor Vk[4], diff, tmp;
+	for (unsigned j = first; j < cand.size(); ++j) {
+		if (w[j].c[0] == 0) {
+			continue;
+		}
+		members[cand[j]].tape.evalTaylor(S, Vk, order, work);
+		for (unsigned i = 0; i < 4; ++i) {
+			tSub(Vk[i], V[i], diff, order);
+			tMul(w[j], diff, tmp, order);
+			tAdd(V[i], tmp, diff, order);
+			V[i] = diff;
+		}
+	}
+}
+
+
+void FieldAtlas::eval(const double s[4], double d[4][4]) const {
+
+	const vector<unsigned> &cand = candidates(s);
+
+	tFlowDerivatives(s, d, [this, &cand](const Taylor S[4], Taylor V[4], unsigned order) {
+		blend(cand, S, V, order);
+	});
+}
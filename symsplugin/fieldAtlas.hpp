@@ -0,0 +1,73 @@
+// Field atlas: a background field, overridden inside boxes or spheres by the
+// next fields, blended over a margin. D1..D4 of the blended field come from
+// Taylor arithmetic on compiled tapes. One field per line of the file, paths
+// relative to it:
+//	spiral-field.txt  all
+//	circle-field.txt  box     xmin ymin zmin  xmax ymax zmax  margin
+//	vector-field.txt  sphere  cx cy cz  radius  margin
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ginac/ginac.h>
+#include "exprTape.hpp"
+
+
+struct AtlasRegion {
+	enum Type { ALL, BOX, SPHERE } type;
+	double lo[3], hi[3];		// box corners; sphere bounding box
+	double center[3];
+	double radius;
+	double margin;				// blending width, inside the region
+};
+
+
+class FieldAtlas {
+
+	private:
+
+		static const unsigned GRID_N = 8;		// cells per axis
+
+		struct Member {
+			std::string file;
+			AtlasRegion region;
+			ExprTape tape;
+		};
+
+		std::vector<Member> members;
+
+		// Members with a region that touches each cell, in priority order
+		double gridLo[3], gridCell[3];
+		std::vector<std::vector<unsigned>> cells;
+		std::vector<unsigned> everywhere;		// 'all' regions, not background
+
+		void buildIndex(void);
+		const std::vector<unsigned>& candidates(const double s[4]) const;
+
+		// Blended field at S, coefficients 0..order
+		void blend(const std::vector<unsigned> &cand, const Taylor S[4],
+				Taylor V[4], unsigned order) const;
+
+	public:
+
+		// false on errors; the atlas is left empty
+		bool load(const std::string &path, const std::vector<GiNaC::symbol> &vars);
+
+		// d[k][i] is the component i of the derivative of order k+1 at s
+		void eval(const double s[4], double d[4][4]) const;
+
+		void clear(void) {
+			members.clear();
+			cells.clear();
+			everywhere.clear();
+		}
+
+		bool isEnabled(void) const {
+			return !members.empty();
+		}
+
+		unsigned size(void) const {
+			return members.size();
+		}
+};
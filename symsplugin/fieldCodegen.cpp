@@ -0,0 +1,184 @@
+
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include "fieldCodegen.hpp"
+
+using namespace GiNaC;
+using std::string;
+using std::vector;
+
+
+// GiNaC function name -> template
+static const std::map<string, string> unaryTemplates = {
+	{"sin", "fk::Sin"}, {"cos", "fk::Cos"}, {"tan", "fk::Tan"},
+	{"asin", "fk::Asin"}, {"acos", "fk::Acos"}, {"atan", "fk::Atan"},
+	{"sinh", "fk::Sinh"}, {"cosh", "fk::Cosh"}, {"tanh", "fk::Tanh"},
+	{"exp", "fk::Exp"}, {"log", "fk::Log"}, {"abs", "fk::Abs"},
+};
+
+
+string KernelCodeGen::emitConst(double value) {
+
+	std::ostringstream os;
+	string name = "C" + std::to_string(nConsts++);
+	os << std::setprecision(17) << "struct " << name <<
+		" { static constexpr double value = " << value << "; };";
+	decls.push_back(os.str());
+
+	return "fk::Const<" + name + ">";
+}
+
+
+// A shared subtree is read from its slot, after the inputs
+string KernelCodeGen::emitNode(const ex &e, const string &type) {
+
+	string name = "E" + std::to_string(nTypes++);
+	decls.push_back("typedef " + type + " " + name + ";");
+	if (uses[e] > 1) {
+		slots.push_back(name);
+		name = "fk::In<fk::SLOT_BASE + " + std::to_string(slots.size() - 1) + ">";
+	}
+	names[e] = name;
+	return name;
+}
+
+
+// Times each subtree is an operand, counting each distinct parent once
+void KernelCodeGen::countUses(const ex &e) {
+
+	if (uses[e]++ > 0) {
+		return;
+	}
+	if (leafIndex(e) >= 0) {
+		return;
+	}
+	for (size_t i = 0; i < e.nops(); ++i) {
+		countUses(e.op(i));
+	}
+}
+
+
+string KernelCodeGen::emit(const ex &e) {
+
+	auto found = names.find(e);
+	if (found != names.end()) {
+		return found->second;
+	}
+	found = consts.find(e);
+	if (found != consts.end()) {
+		return found->second;
+	}
+
+	// Inputs
+	int index = leafIndex(e);
+	if (index >= 0) {
+		return "fk::In<" + std::to_string(index) + ">";
+	}
+
+	// Numbers and constants like Pi
+	if (is_a<numeric>(e) || is_a<constant>(e)) {
+		ex v = e.evalf();
+		if (!is_a<numeric>(v) || !ex_to<numeric>(v).is_real()) {
+			throw std::runtime_error("Codegen: not a real constant");
+		}
+		string c = emitConst(ex_to<numeric>(v).to_double());
+		consts[e] = c;
+		return c;
+	}
+
+	// n-ary operators
+	if (is_a<add>(e) || is_a<mul>(e)) {
+		string type = is_a<add>(e) ? "fk::Add<" : "fk::Mul<";
+		for (size_t i = 0; i < e.nops(); ++i) {
+			type += (i ? ", " : "") + emit(e.op(i));
+		}
+		return emitNode(e, type + ">");
+	}
+
+	if (is_a<power>(e)) {
+		string base = emit(e.op(0));
+		const ex &expo = e.op(1);
+		if (is_a<numeric>(expo) && ex_to<numeric>(expo).is_integer()) {
+			return emitNode(e, "fk::IPow<" + base + ", " +
+					std::to_string(ex_to<numeric>(expo).to_int()) + ">");
+		}
+		if (expo.is_equal(numeric(1,2))) {
+			return emitNode(e, "fk::Sqrt<" + base + ">");
+		}
+		if (expo.is_equal(numeric(-1,2))) {
+			return emitNode(e, "fk::IPow<fk::Sqrt<" + base + ">, -1>");
+		}
+		return emitNode(e, "fk::Pow<" + base + ", " + emit(expo) + ">");
+	}
+
+	if (is_a<function>(e)) {
+		string fName = ex_to<function>(e).get_name();
+		if (fName == "atan2") {
+			return emitNode(e, "fk::Atan2<" + emit(e.op(0)) + ", " + emit(e.op(1)) + ">");
+		}
+		auto templ = unaryTemplates.find(fName);
+		if (templ != unaryTemplates.end() && e.nops() == 1) {
+			return emitNode(e, templ->second + "<" + emit(e.op(0)) + ">");
+		}
+		throw std::runtime_error("Codegen: unsupported function " + fName);
+	}
+
+	std::ostringstream os;
+	os << "Codegen: unsupported expression " << e;
+	throw std::runtime_error(os.str());
+}
+
+
+void KernelCodeGen::addList(const string &name, const vector<ex> &exprs) {
+
+	// Slots are per list: the lists have different inputs
+	names.clear();
+	uses.clear();
+	slots.clear();
+	for (const ex &e : exprs) {
+		countUses(e);
+	}
+
+	string type = "fk::List<";
+	for (size_t i = 0; i < exprs.size(); ++i) {
+		type += (i ? ", " : "") + emit(exprs[i]);
+	}
+
+	string slotList = "fk::List<";
+	for (size_t i = 0; i < slots.size(); ++i) {
+		slotList += (i ? ", " : "") + slots[i];
+	}
+	decls.push_back("typedef " + slotList + "> " + name + "Slots;");
+	decls.push_back("static const unsigned " + name + "SlotCount = " +
+			std::to_string(slots.size()) + ";");
+	decls.push_back("typedef " + type + "> " + name + ";");
+}
+
+
+void KernelCodeGen::write(std::ostream &os, const string &structName,
+		const vector<string> &extra) const {
+
+	os << "// Generated by fieldCodegen: do not edit\n\n";
+	os << "#pragma once\n\n";
+	os << "#include \"fieldKernel.hpp\"\n\n\n";
+	os << "struct " << structName << " {\n\n";
+	for (const string &line : extra) {
+		os << "\t" << line << "\n";
+	}
+	os << "\n";
+	for (const string &line : decls) {
+		os << "\t" << line << "\n";
+	}
+	os << "};\n";
+}
+
+
+uint64_t fieldContentHash(const string &text) {
+
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : text) {
+		hash = (hash ^ c) * 1099511628211ULL;
+	}
+	return hash;
+}
@@ -0,0 +1,55 @@
+// Translates GiNaC expressions into the expression templates of
+// fieldKernel.hpp. A subtree used more than once in a list is evaluated
+// once, into a slot of the input array, before the list
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <functional>
+#include <ginac/ginac.h>
+
+
+class KernelCodeGen {
+
+	public:
+		// Returns the input index of a leaf (symbol or function), -1 if
+		//	the expression is not a leaf
+		typedef std::function<int(const GiNaC::ex&)> LeafMap;
+
+	private:
+		LeafMap leafIndex;
+
+		typedef std::map<GiNaC::ex, std::string, GiNaC::ex_is_less> NameMap;
+		NameMap consts;
+		NameMap names;			// of the current list
+		std::map<GiNaC::ex, unsigned, GiNaC::ex_is_less> uses;
+		std::vector<std::string> slots;		// of the current list, in dependency order
+		std::vector<std::string> decls;		// in dependency order
+		unsigned nTypes = 0;
+		unsigned nConsts = 0;
+
+		void countUses(const GiNaC::ex &e);
+		std::string emit(const GiNaC::ex &e);
+		std::string emitConst(double value);
+		std::string emitNode(const GiNaC::ex &e, const std::string &type);
+
+	public:
+
+		KernelCodeGen(LeafMap leaf): leafIndex(leaf) {}
+
+		// Declares: typedef fk::List<...> name; typedef fk::List<...> nameSlots;
+		//	static const unsigned nameSlotCount
+		void addList(const std::string &name, const std::vector<GiNaC::ex> &exprs);
+
+		// The struct with all the declarations, extra lines appended as they are
+		void write(std::ostream &os, const std::string &structName,
+				const std::vector<std::string> &extra) const;
+};
+
+
+// FNV-1a of the field file: the compiled kernel is used only for the same text
+uint64_t fieldContentHash(const std::string &text);
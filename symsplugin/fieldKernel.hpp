@@ -0,0 +1,175 @@
+// Expression templates of a field kernel specialized at compile time (see
+// "make kernel" and fieldCodegen.hpp). Leaves read in[4*n + i]: derivative
+// n (0..4) of the flat output i (x, y, z, w); shared subtrees read their
+// slot, in[SLOT_BASE + k], evaluated once before the expressions
+
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+
+
+namespace fk {
+
+// Inputs in[0..19], then the slots of the shared subtrees
+static const unsigned SLOT_BASE = 20;
+
+// Flat output i, derivative n: In<4*n+i>
+template <unsigned K>
+struct In {
+	static inline double eval(const double *in) {
+		return in[K];
+	}
+};
+
+
+// C must define: static constexpr double value
+template <class C>
+struct Const {
+	static inline double eval(const double *) {
+		return C::value;
+	}
+};
+
+
+template <class... T> struct Add;
+
+template <class A>
+struct Add<A> {
+	static inline double eval(const double *in) {
+		return A::eval(in);
+	}
+};
+
+template <class A, class... T>
+struct Add<A, T...> {
+	static inline double eval(const double *in) {
+		return A::eval(in) + Add<T...>::eval(in);
+	}
+};
+
+
+template <class... T> struct Mul;
+
+template <class A>
+struct Mul<A> {
+	static inline double eval(const double *in) {
+		return A::eval(in);
+	}
+};
+
+template <class A, class... T>
+struct Mul<A, T...> {
+	static inline double eval(const double *in) {
+		return A::eval(in) * Mul<T...>::eval(in);
+	}
+};
+
+
+// Integer powers, unrolled at compile time
+template <unsigned N>
+struct UPow {
+	static inline double of(double x) {
+		return ((N & 1) ? x : 1.0) * UPow<N/2>::of(x*x);
+	}
+};
+
+template <>
+struct UPow<0> {
+	static inline double of(double) {
+		return 1;
+	}
+};
+
+template <class A, int N>
+struct IPow {
+	static inline double eval(const double *in) {
+		return (N >= 0) ? UPow<(N >= 0 ? N : -N)>::of(A::eval(in)) :
+				1.0 / UPow<(N >= 0 ? N : -N)>::of(A::eval(in));
+	}
+};
+
+template <class A, class B>
+struct Pow {
+	static inline double eval(const double *in) {
+		return std::pow(A::eval(in), B::eval(in));
+	}
+};
+
+
+#define FK_UNARY(NAME, FUNC)								\
+template <class A>											\
+struct NAME {												\
+	static inline double eval(const double *in) {			\
+		return FUNC(A::eval(in));							\
+	}														\
+};
+
+FK_UNARY(Sqrt, std::sqrt)
+FK_UNARY(Exp, std::exp)
+FK_UNARY(Log, std::log)
+FK_UNARY(Sin, std::sin)
+FK_UNARY(Cos, std::cos)
+FK_UNARY(Tan, std::tan)
+FK_UNARY(Asin, std::asin)
+FK_UNARY(Acos, std::acos)
+FK_UNARY(Atan, std::atan)
+FK_UNARY(Sinh, std::sinh)
+FK_UNARY(Cosh, std::cosh)
+FK_UNARY(Tanh, std::tanh)
+FK_UNARY(Abs, std::fabs)
+
+#undef FK_UNARY
+
+template <class A, class B>
+struct Atan2 {
+	static inline double eval(const double *in) {
+		return std::atan2(A::eval(in), B::eval(in));
+	}
+};
+
+
+// Evaluates a list of expressions into out[0..]
+template <class... T> struct List;
+
+template <>
+struct List<> {
+	static inline void eval(const double *, double *) {}
+};
+
+template <class A, class... T>
+struct List<A, T...> {
+	static inline void eval(const double *in, double *out) {
+		*out = A::eval(in);
+		List<T...>::eval(in, out+1);
+	}
+};
+
+} // namespace fk
+
+
+/*
+ * The generated FieldKernel struct defines:
+ *	fieldName, fieldHash, mass, J(r,c)
+ *	Derivatives: list of D1..D4, 16 expressions of in[0..3], order-major
+ *	FlatnessMap: list of phi, theta, omega (paper global frame, 3),
+ *		u_torque (paper body frame, 3), u_thrust; expressions of in[0..19]
+ *	for each list, nameSlots and nameSlotCount: its shared subtrees
+ */
+
+template <class K>
+inline void kernelDerivatives(const double s[4], double d[4][4]) {
+	double in[fk::SLOT_BASE + K::DerivativesSlotCount];
+	std::copy(s, s+4, in);
+	K::DerivativesSlots::eval(in, in + fk::SLOT_BASE);
+	K::Derivatives::eval(in, &d[0][0]);
+}
+
+template <class K>
+inline void kernelFlatnessMap(const double in[20], double out[9]) {
+	double work[fk::SLOT_BASE + K::FlatnessMapSlotCount];
+	std::copy(in, in+20, work);
+	K::FlatnessMapSlots::eval(work, work + fk::SLOT_BASE);
+	K::FlatnessMap::eval(work, out);
+}
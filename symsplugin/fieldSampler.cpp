@@ -0,0 +1,95 @@
+
+#include <thread>
+#include <algorithm>
+#include "fieldSampler.hpp"
+
+using std::vector;
+
+
+void SampleGrid::point(unsigned p, double s[4]) const {
+
+	unsigned idx[3] = {p % n[0], (p / n[0]) % n[1], p / (n[0] * n[1])};
+	for (unsigned i = 0; i < 3; ++i) {
+		s[i] = (n[i] > 1) ? lo[i] + (hi[i] - lo[i]) * idx[i] / (n[i] - 1) : lo[i];
+	}
+	s[3] = yaw;
+}
+
+
+bool SampleGrid::operator==(const SampleGrid &o) const {
+
+	for (unsigned i = 0; i < 3; ++i) {
+		if (lo[i] != o.lo[i] || hi[i] != o.hi[i] || n[i] != o.n[i]) {
+			return false;
+		}
+	}
+	return yaw == o.yaw;
+}
+
+
+void parallelFor(unsigned count, const std::function<void(unsigned, unsigned)> &job) {
+
+	unsigned nThreads = std::max(1u, std::thread::hardware_concurrency());
+	nThreads = std::min(nThreads, std::max(1u, count / 256));
+
+	vector<std::thread> threads;
+	unsigned chunk = (count + nThreads - 1) / nThreads;
+	for (unsigned t = 1; t < nThreads; ++t) {
+		unsigned first = t * chunk;
+		threads.push_back(std::thread(job, first, std::min(count, first + chunk)));
+	}
+	job(0, std::min(count, chunk));
+
+	for (std::thread &t : threads) {
+		t.join();
+	}
+}
+
+
+void sampleField(const SampleGrid &grid, unsigned orders, const FieldEval &eval,
+		vector<double> &out) {
+
+	orders = std::min(std::max(orders, 1u), 4u);
+	out.resize(grid.size() * orders * 4);
+
+	parallelFor(grid.size(), [&](unsigned first, unsigned last) {
+		double s[4], d[4][4];
+		for (unsigned p = first; p < last; ++p) {
+			grid.point(p, s);
+			eval(s, d, orders);
+			std::copy(&d[0][0], &d[0][0] + orders*4, &out[p*orders*4]);
+		}
+	});
+}
+
+
+void traceStreamlines(const SampleGrid &grid, unsigned steps, double dt,
+		const FieldEval &eval, vector<double> &out) {
+
+	out.resize(grid.size() * (steps + 1) * 3);
+
+	parallelFor(grid.size(), [&](unsigned first, unsigned last) {
+		double s[4], tmp[4], k[4][4], d[4][4];
+		for (unsigned p = first; p < last; ++p) {
+			grid.point(p, s);
+			double *line = &out[p * (steps + 1) * 3];
+			std::copy(s, s+3, line);
+
+			for (unsigned j = 1; j <= steps; ++j) {
+				// RK4 on the flat outputs
+				const double c[4] = {0, 0.5, 0.5, 1};
+				for (unsigned stage = 0; stage < 4; ++stage) {
+					for (unsigned i = 0; i < 4; ++i) {
+						tmp[i] = s[i] + (stage ? c[stage] * dt * k[stage-1][i] : 0);
+					}
+					eval(tmp, d, 1);
+					std::copy(d[0], d[0]+4, k[stage]);
+				}
+				for (unsigned i = 0; i < 4; ++i) {
+					s[i] += dt / 6 * (k[0][i] + 2*k[1][i] + 2*k[2][i] + k[3][i]);
+				}
+				std::copy(s, s+3, line + j*3);
+			}
+		}
+	});
+}
@@ -0,0 +1,41 @@
+// Bulk sampling of a field on a regular 3D grid, in parallel: the evaluator
+// must be thread-safe. Results in flat arrays, x fastest, z slowest
+
+#pragma once
+
+#include <vector>
+#include <functional>
+
+
+struct SampleGrid {
+	double lo[3], hi[3];
+	unsigned n[3];				// points per axis
+	double yaw;					// 4th flat output, the same everywhere
+
+	unsigned size(void) const {
+		return n[0] * n[1] * n[2];
+	}
+
+	// Flat outputs of the point p
+	void point(unsigned p, double s[4]) const;
+
+	bool operator==(const SampleGrid &o) const;
+};
+
+
+// Fills d[k] for the orders k < orders (D1, D2, ...)
+typedef std::function<void(const double s[4], double d[4][4], unsigned orders)> FieldEval;
+
+
+// out[(p*orders + k)*4 + i]: component i of D(k+1) at the grid point p
+void sampleField(const SampleGrid &grid, unsigned orders, const FieldEval &eval,
+		std::vector<double> &out);
+
+// Integrates s' = D1(s) with RK4 from every grid point:
+//	out[(p*(steps+1) + j)*3 + i]: coordinate i of the point j of the line p
+void traceStreamlines(const SampleGrid &grid, unsigned steps, double dt,
+		const FieldEval &eval, std::vector<double> &out);
+
+// Runs job(first, last) on contiguous chunks of [0, count), in parallel
+//	if there are at least 256 items per thread
+void parallelFor(unsigned count, const std::function<void(unsigned, unsigned)> &job);
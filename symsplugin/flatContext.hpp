@@ -0,0 +1,44 @@
+// Evaluation context of the symbolic equations: the numeric flat outputs and
+// derivatives symF(index, n, t) evaluates to, per thread; by default the
+// plugin globals flatOut and flatOut1..4. GiNaC is not thread-safe: every
+// evaluation holds ginacMutex, so the contexts don't make it parallel
+
+#pragma once
+
+#include <mutex>
+#include <ginac/ginac.h>
+
+
+// Index tags of the flat outputs in symF()
+enum FlatIndex {
+	FLAT_X, FLAT_Y, FLAT_Z, FLAT_YAW
+};
+
+
+struct FlatContext {
+	const GiNaC::ex *values[5];		// values[n][index]
+};
+
+
+extern thread_local const FlatContext *flatContext;
+extern std::recursive_mutex ginacMutex;		// held by every GiNaC evaluation
+
+
+class FlatContextScope {
+
+	private:
+		const FlatContext *previous;
+
+	public:
+
+		explicit FlatContextScope(const FlatContext &ctx) : previous(flatContext) {
+			flatContext = &ctx;
+		}
+
+		~FlatContextScope() {
+			flatContext = previous;
+		}
+
+		FlatContextScope(const FlatContextScope&) = delete;
+		FlatContextScope& operator=(const FlatContextScope&) = delete;
+};
@@ -0,0 +1,123 @@
+
+#include <cmath>
+#include "flatnessMap.hpp"
+
+
+// A quantity with its first two time derivatives
+struct Jet {
+	double v, d1, d2;
+};
+
+static inline Jet operator+(const Jet &a, const Jet &b) {
+	return Jet{a.v + b.v, a.d1 + b.d1, a.d2 + b.d2};
+}
+
+static inline Jet operator-(const Jet &a, const Jet &b) {
+	return Jet{a.v - b.v, a.d1 - b.d1, a.d2 - b.d2};
+}
+
+static inline Jet operator-(const Jet &a) {
+	return Jet{-a.v, -a.d1, -a.d2};
+}
+
+static inline Jet operator*(const Jet &a, const Jet &b) {
+	return Jet{a.v * b.v, a.d1 * b.v + a.v * b.d1,
+		a.d2 * b.v + 2 * a.d1 * b.d1 + a.v * b.d2};
+}
+
+// f(a), given f, f' and f'' at a.v
+static inline Jet chain(const Jet &a, double f, double df, double ddf) {
+	return Jet{f, df * a.d1, ddf * a.d1 * a.d1 + df * a.d2};
+}
+
+static inline Jet sin(const Jet &a) {
+	double s = std::sin(a.v), c = std::cos(a.v);
+	return chain(a, s, c, -s);
+}
+
+static inline Jet cos(const Jet &a) {
+	double s = std::sin(a.v), c = std::cos(a.v);
+	return chain(a, c, -s, -c);
+}
+
+static inline Jet sqrt(const Jet &a) {
+	double r = std::sqrt(a.v);
+	return chain(a, r, 0.5 / r, -0.25 / (r * a.v));
+}
+
+static inline Jet atan2(const Jet &u, const Jet &w) {
+	double r2 = u.v * u.v + w.v * w.v;
+	double n = w.v * u.d1 - u.v * w.d1;
+	double dn = w.v * u.d2 - u.v * w.d2;
+	double dr2 = 2 * (u.v * u.d1 + w.v * w.d1);
+	return Jet{std::atan2(u.v, w.v), n / r2, (dn * r2 - n * dr2) / (r2 * r2)};
+}
+
+// Time derivative: the second derivative of the result is not known
+static inline Jet deriv(const Jet &a) {
+	return Jet{a.d1, a.d2, 0};
+}
+
+
+void flatnessMap(const double in[20], double mass, const double J[9],
+		double gravity, double out[9]) {
+
+	// Accelerations with jerk and snap; yaw with its rates
+	Jet ax{in[8], in[12], in[16]};
+	Jet ay{in[9], in[13], in[17]};
+	Jet az{in[10], in[14], in[18]};
+	Jet psi{in[3], in[7], in[11]};
+	Jet g{gravity, 0, 0};
+
+	// State equations, as genSymbolicEquations()
+	Jet cpsi = cos(psi), spsi = sin(psi);
+	Jet ba = -cpsi * ax - spsi * ay;
+	Jet bb = g - az;
+	Jet bc = -spsi * ax + cpsi * ay;
+
+	Jet phi = atan2(bc, sqrt(ba * ba + bb * bb));
+	Jet theta = atan2(ba, bb);
+
+	// Euler rates rpy to angular velocity in body frame (rpyRate2omega),
+	//	value and first derivative
+	Jet d_phi = deriv(phi), d_theta = deriv(theta), d_psi = deriv(psi);
+	Jet cphi = cos(phi), sphi = sin(phi);
+	Jet ctheta = cos(theta), stheta = sin(theta);
+
+	Jet omegaJ[3] = {
+		d_phi - stheta * d_psi,
+		cphi * d_theta + ctheta * sphi * d_psi,
+		-sphi * d_theta + cphi * ctheta * d_psi};
+
+	double omega[3] = {omegaJ[0].v, omegaJ[1].v, omegaJ[2].v};
+	double d_omega[3] = {omegaJ[0].d1, omegaJ[1].d1, omegaJ[2].d1};
+
+	// Torque: J * d_omega + omega x (J * omega)
+	double Jw[3], Jdw[3];
+	for (unsigned r = 0; r < 3; ++r) {
+		Jw[r] = J[r*3] * omega[0] + J[r*3+1] * omega[1] + J[r*3+2] * omega[2];
+		Jdw[r] = J[r*3] * d_omega[0] + J[r*3+1] * d_omega[1] + J[r*3+2] * d_omega[2];
+	}
+	out[5] = Jdw[0] + omega[1] * Jw[2] - omega[2] * Jw[1];
+	out[6] = Jdw[1] + omega[2] * Jw[0] - omega[0] * Jw[2];
+	out[7] = Jdw[2] + omega[0] * Jw[1] - omega[1] * Jw[0];
+
+	// Thrust: mass * |acc - g*e3|
+	out[8] = mass * std::sqrt(ax.v * ax.v + ay.v * ay.v + (az.v - gravity) * (az.v - gravity));
+
+	// Angular velocity in global frame: R * omega, R = rpy2matrix(phi, theta, psi)
+	double cr = cphi.v, sr = sphi.v;
+	double cp = ctheta.v, sp = stheta.v;
+	double cy = cpsi.v, sy = spsi.v;
+	double R[3][3] = {
+		{cy*cp, cy*sp*sr - sy*cr, cy*sp*cr + sy*sr},
+		{sy*cp, sy*sp*sr + cy*cr, sy*sp*cr - cy*sr},
+		{-sp, cp*sr, cp*cr}};
+
+	for (unsigned r = 0; r < 3; ++r) {
+		out[2+r] = R[r][0] * omega[0] + R[r][1] * omega[1] + R[r][2] * omega[2];
+	}
+
+	out[0] = phi.v;
+	out[1] = theta.v;
+}
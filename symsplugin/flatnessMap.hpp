@@ -0,0 +1,10 @@
+// Numeric flatness map: attitude, angular velocity and inputs from the flat
+// outputs and their derivatives, with the equations of genSymbolicEquations()
+// (paper convention). The rates of phi and theta use the chain rule on jets
+
+#pragma once
+
+
+// J: inertia matrix, row-major
+void flatnessMap(const double in[20], double mass, const double J[9],
+		double gravity, double out[9]);
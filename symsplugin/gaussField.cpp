@@ -0,0 +1,395 @@
+
+#include <cmath>
+#include <algorithm>
+#include "gaussField.hpp"
+#include "polyField.hpp"
+
+using namespace GiNaC;
+using std::vector;
+
+
+// Bound of a skipped term and of its spatial derivatives up to CUTOFF_ORDER
+static const double TOLERANCE = 1e-12;
+static const unsigned CUTOFF_ORDER = 3;
+
+
+static ExprTape::LeafMap varsLeaf(const vector<symbol> &vars) {
+
+	return [vars](const ex &e) -> int {
+		for (unsigned i = 0; i < vars.size(); ++i) {
+			if (e.is_equal(vars[i])) {
+				return i;
+			}
+		}
+		return -1;
+	};
+}
+
+
+static bool toDouble(const ex &e, double &v) {
+
+	ex f = e.evalf();
+	if (!is_a<numeric>(f) || !ex_to<numeric>(f).is_real()) {
+		return false;
+	}
+	v = ex_to<numeric>(f).to_double();
+	return true;
+}
+
+
+// Smallest eigenvalue of a symmetric n x n matrix (n <= 3), Jacobi sweeps
+static double minEigenvalue(double A[3][3], unsigned n) {
+
+	for (unsigned sweep = 0; sweep < 50; ++sweep) {
+		double off = 0;
+		for (unsigned p = 0; p < n; ++p) {
+			for (unsigned q = p+1; q < n; ++q) {
+				off += A[p][q] * A[p][q];
+			}
+		}
+		if (off < 1e-30) {
+			break;
+		}
+		for (unsigned p = 0; p < n; ++p) {
+			for (unsigned q = p+1; q < n; ++q) {
+				if (A[p][q] == 0) {
+					continue;
+				}
+				double theta = (A[q][q] - A[p][p]) / (2 * A[p][q]);
+				double t = ((theta >= 0) ? 1 : -1) /
+					(std::fabs(theta) + std::sqrt(theta * theta + 1));
+				double c = 1 / std::sqrt(t * t + 1), s = t * c;
+				for (unsigned k = 0; k < n; ++k) {		// A = A * J
+					double akp = A[k][p], akq = A[k][q];
+					A[k][p] = c * akp - s * akq;
+					A[k][q] = s * akp + c * akq;
+				}
+				for (unsigned k = 0; k < n; ++k) {		// A = J^T * A
+					double apk = A[p][k], aqk = A[q][k];
+					A[p][k] = c * apk - s * aqk;
+					A[q][k] = s * apk + c * aqk;
+				}
+			}
+		}
+	}
+
+	double m = A[0][0];
+	for (unsigned i = 1; i < n; ++i) {
+		m = std::min(m, A[i][i]);
+	}
+	return m;
+}
+
+
+// Solves A x = b, n <= 3, Gaussian elimination with pivoting
+static bool solve(double A[3][3], double b[3], unsigned n, double x[3]) {
+
+	for (unsigned c = 0; c < n; ++c) {
+		unsigned piv = c;
+		for (unsigned r = c+1; r < n; ++r) {
+			if (std::fabs(A[r][c]) > std::fabs(A[piv][c])) piv = r;
+		}
+		if (std::fabs(A[piv][c]) < 1e-300) {
+			return false;
+		}
+		std::swap(A[c], A[piv]);
+		std::swap(b[c], b[piv]);
+		for (unsigned r = c+1; r < n; ++r) {
+			double f = A[r][c] / A[c][c];
+			for (unsigned k = c; k < n; ++k) A[r][k] -= f * A[c][k];
+			b[r] -= f * b[c];
+		}
+	}
+	for (int r = n-1; r >= 0; --r) {
+		double s = b[r];
+		for (unsigned k = r+1; k < n; ++k) s -= A[r][k] * x[k];
+		x[r] = s / A[r][r];
+	}
+	return true;
+}
+
+
+GaussField::GaussField(): global(ExprTape::LeafMap()) {
+}
+
+
+// e = P * exp(Q): fills centre, cutoff radius and tape of the term
+bool GaussField::localTerm(const ex &e, const vector<symbol> &vars, Term &t) const {
+
+	// Split the exponentials from the prefactor
+	ex Q = 0, P = 1;
+	bool found = false;
+	vector<ex> factors;
+	if (is_a<mul>(e)) {
+		for (size_t i = 0; i < e.nops(); ++i) factors.push_back(e.op(i));
+	} else {
+		factors.push_back(e);
+	}
+	for (const ex &f : factors) {
+		if (is_a<function>(f) && ex_to<GiNaC::function>(f).get_name() == "exp") {
+			Q += f.op(0);
+			found = true;
+		} else {
+			P *= f;
+		}
+	}
+	if (!found || vars.size() < 3 || (vars.size() > 3 && (Q.has(vars[3]) || P.has(vars[3])))) {
+		return false;
+	}
+
+	// Q = Q0 + g.p + 1/2 p.H.p, on the axes it depends on
+	lst axesLst;
+	unsigned axis[3], n = 0;
+	t.axes = 0;
+	for (unsigned i = 0; i < 3; ++i) {
+		if (Q.has(vars[i])) {
+			axis[n++] = i;
+			axesLst.append(vars[i]);
+			t.axes |= 1 << i;
+		}
+	}
+	if (n == 0 || !Q.is_polynomial(axesLst) || !P.is_polynomial(axesLst)) {
+		return false;
+	}
+	for (unsigned i = 0; i < 3; ++i) {
+		if (!(t.axes & (1 << i)) && P.has(vars[i])) {
+			return false;		// the prefactor grows along an unbounded axis
+		}
+	}
+
+	exmap origin;
+	for (unsigned i = 0; i < 3; ++i) {
+		origin[vars[i]] = 0;
+	}
+
+	double H[3][3], negH[3][3], g[3], Q0;
+	if (!toDouble(Q.subs(origin), Q0)) {
+		return false;
+	}
+	for (unsigned a = 0; a < n; ++a) {
+		ex dQ = Q.diff(vars[axis[a]]);
+		if (!toDouble(dQ.subs(origin), g[a])) {
+			return false;
+		}
+		for (unsigned b = 0; b < n; ++b) {
+			ex ddQ = dQ.diff(vars[axis[b]]);
+			if (ddQ.has(vars[0]) || ddQ.has(vars[1]) || ddQ.has(vars[2]) ||
+					!toDouble(ddQ, H[a][b])) {
+				return false;		// not quadratic
+			}
+			negH[a][b] = -H[a][b];
+		}
+	}
+
+	// Concave: -H positive definite
+	double lambda = minEigenvalue(negH, n);
+	if (!(lambda > 0)) {
+		return false;
+	}
+
+	// Centre: H c = -g; Q(c) = Q0 + g.c/2
+	double c[3], minusG[3];
+	for (unsigned a = 0; a < n; ++a) minusG[a] = -g[a];
+	if (!solve(H, minusG, n, c)) {
+		return false;
+	}
+	double Qc = Q0, cNorm = 0;
+	for (unsigned a = 0; a < n; ++a) {
+		Qc += g[a] * c[a] / 2;
+		cNorm += c[a] * c[a];
+	}
+	cNorm = std::sqrt(cNorm);
+
+	// |P(p)| <= sum |coeff| * max(1, |p|)^degree
+	PolyField poly;
+	vector<symbol> axesVars;
+	for (unsigned a = 0; a < n; ++a) axesVars.push_back(vars[axis[a]]);
+	if (!poly.set(P, axesVars)) {
+		return false;
+	}
+
+	// Largest curvature of Q, bounded by the Frobenius norm of H
+	double Lambda = 0;
+	for (unsigned a = 0; a < n; ++a) {
+		for (unsigned b = 0; b < n; ++b) {
+			Lambda += H[a][b] * H[a][b];
+		}
+	}
+	Lambda = std::sqrt(Lambda);
+
+	// Cutoff, at distance r from the centre: exp(Q) <= exp(Qc - lambda r^2 / 2);
+	//	a derivative of order j of P is below sum |coeff| * deg^j * R^deg, with
+	//	R = max(1, |c| + r); one of order k of exp(Q) is exp(Q) times a
+	//	polynomial in grad Q (|grad Q| <= Lambda r) and H, below
+	//	(Lambda r + sqrt(k Lambda))^k. Leibniz for the orders up to CUTOFF_ORDER.
+	//	The polynomial factors first make it grow with r: the cutoff is past
+	//	its maximum, where it decreases
+	double step = 0.25 / std::sqrt(lambda);
+	double r = 0;
+	double previous = 0;
+	for (unsigned it = 0; ; ++it, r += step) {
+		double R = std::max(1.0, cNorm + r);
+		double bound = 0;
+		for (unsigned m = 0; m <= CUTOFF_ORDER; ++m) {
+			double G = Lambda * r + std::sqrt(m * Lambda);
+			double boundM = 0, binomial = 1;
+			for (unsigned j = 0; j <= m; ++j) {
+				double boundP = 0;
+				for (const PolyTerm &pt : poly.getTerms()) {
+					unsigned deg = pt.e[0] + pt.e[1] + pt.e[2] + pt.e[3];
+					boundP += std::fabs(pt.c) * std::pow(deg, j) * std::pow(R, deg);
+				}
+				boundM += binomial * boundP * std::pow(G, m - j);
+				binomial = binomial * (m - j) / (j + 1);
+			}
+			bound = std::max(bound, boundM);
+		}
+		double skipped = std::exp(Qc - lambda * r * r / 2) * bound;
+		if (it > 0 && skipped < TOLERANCE && skipped < previous) {
+			break;
+		}
+		previous = skipped;
+		if (it > 10000) {
+			return false;
+		}
+	}
+
+	for (unsigned i = 0; i < 3; ++i) {
+		t.center[i] = 0;
+	}
+	for (unsigned a = 0; a < n; ++a) {
+		t.center[axis[a]] = c[a];
+	}
+	t.radius = r;
+
+	return t.tape.compile({e});
+}
+
+
+bool GaussField::set(const vector<ex> &field, const vector<symbol> &vars) {
+
+	clear();
+	ExprTape::LeafMap leaf = varsLeaf(vars);
+
+	vector<ex> others(4, 0);
+	for (unsigned comp = 0; comp < field.size() && comp < 4; ++comp) {
+		ex e = field[comp].expand();
+		vector<ex> addends;
+		if (is_a<add>(e)) {
+			for (size_t i = 0; i < e.nops(); ++i) addends.push_back(e.op(i));
+		} else {
+			addends.push_back(e);
+		}
+
+		for (const ex &a : addends) {
+			Term t{comp, 0, {0, 0, 0}, 0, ExprTape(leaf)};
+			if (localTerm(a, vars, t)) {
+				terms.push_back(t);
+			} else {
+				others[comp] += a;
+			}
+		}
+	}
+
+	global = ExprTape(leaf);
+	if (terms.empty() || !global.compile(others)) {
+		clear();
+		return false;
+	}
+
+	buildIndex();
+	enabled = true;
+	return true;
+}
+
+
+void GaussField::buildIndex(void) {
+
+	// Grid over the cutoff boxes, cells about as large as the median radius
+	double hi[3];
+	vector<double> radii;
+	for (unsigned i = 0; i < 3; ++i) {
+		gridLo[i] = 0;
+		hi[i] = 0;
+		bool first = true;
+		for (const Term &t : terms) {
+			if (t.axes & (1 << i)) {
+				gridLo[i] = first ? t.center[i] - t.radius : std::min(gridLo[i], t.center[i] - t.radius);
+				hi[i] = first ? t.center[i] + t.radius : std::max(hi[i], t.center[i] + t.radius);
+				first = false;
+			}
+		}
+	}
+	for (const Term &t : terms) {
+		radii.push_back(t.radius);
+	}
+	std::nth_element(radii.begin(), radii.begin() + radii.size()/2, radii.end());
+	double cell = std::max(radii[radii.size()/2], 1e-9);
+
+	for (unsigned i = 0; i < 3; ++i) {
+		double extent = hi[i] - gridLo[i];
+		gridN[i] = std::max(1u, std::min((unsigned)MAX_CELLS, (unsigned)std::ceil(extent / cell)));
+		gridCell[i] = std::max(extent, 1e-9) / gridN[i];
+	}
+
+	cells.assign(gridN[0] * gridN[1] * gridN[2], vector<unsigned>());
+	for (unsigned k = 0; k < terms.size(); ++k) {
+		const Term &t = terms[k];
+		unsigned from[3], to[3];
+		for (unsigned i = 0; i < 3; ++i) {
+			if (t.axes & (1 << i)) {
+				from[i] = std::min<unsigned>(std::max(0.0, (t.center[i] - t.radius - gridLo[i]) / gridCell[i]), gridN[i]-1);
+				to[i] = std::min<unsigned>(std::max(0.0, (t.center[i] + t.radius - gridLo[i]) / gridCell[i]), gridN[i]-1);
+			} else {
+				from[i] = 0;
+				to[i] = gridN[i] - 1;
+			}
+		}
+		for (unsigned a = from[0]; a <= to[0]; ++a) {
+			for (unsigned b = from[1]; b <= to[1]; ++b) {
+				for (unsigned c = from[2]; c <= to[2]; ++c) {
+					cells[(a * gridN[1] + b) * gridN[2] + c].push_back(k);
+				}
+			}
+		}
+	}
+}
+
+
+void GaussField::eval(const double s[4], double d[4][4]) const {
+
+	thread_local vector<Taylor> work;
+	thread_local vector<unsigned> active;
+
+	// Cell of s, clamped: the terms outside the grid are unbounded on that axis
+	unsigned idx[3];
+	for (unsigned i = 0; i < 3; ++i) {
+		double cell = std::floor((s[i] - gridLo[i]) / gridCell[i]);
+		idx[i] = std::min<double>(std::max(cell, 0.0), gridN[i] - 1);
+	}
+	const vector<unsigned> &cand = cells[(idx[0] * gridN[1] + idx[1]) * gridN[2] + idx[2]];
+
+	active.clear();
+	for (unsigned k : cand) {
+		const Term &t = terms[k];
+		double dist2 = 0;
+		for (unsigned i = 0; i < 3; ++i) {
+			if (t.axes & (1 << i)) {
+				dist2 += (s[i] - t.center[i]) * (s[i] - t.center[i]);
+			}
+		}
+		if (dist2 < t.radius * t.radius) {
+			active.push_back(k);
+		}
+	}
+
+	tFlowDerivatives(s, d, [this](const Taylor S[4], Taylor V[4], unsigned order) {
+		global.evalTaylor(S, V, order, work);
+		Taylor term, sum;
+		for (unsigned k : active) {
+			terms[k].tape.evalTaylor(S, &term, order, work);
+			tAdd(V[terms[k].comp], term, sum, order);
+			V[terms[k].comp] = sum;
+		}
+	});
+}
@@ -0,0 +1,66 @@
+// Culled evaluation of fields made of localized terms P(x,y,z) * exp(Q), P a
+// polynomial and Q a concave quadratic, like the Gaussian obstacles: a grid
+// selects the terms whose cutoff radius reaches the position. D1..D4 along
+// the flow with Taylor arithmetic, as in the field atlas. A skipped term and
+// its spatial derivatives up to the 3rd, that D4 uses, are below 1e-12; the
+// error of Dk is that times products of the lower derivatives of the field
+
+#pragma once
+
+#include <vector>
+#include <ginac/ginac.h>
+#include "exprTape.hpp"
+
+
+class GaussField {
+
+	private:
+
+		struct Term {
+			unsigned comp;			// field component
+			unsigned axes;			// bit i: Q depends on axis i
+			double center[3];
+			double radius;			// cutoff, over the axes in 'axes'
+			ExprTape tape;
+		};
+
+		bool enabled = false;
+
+		std::vector<Term> terms;
+		ExprTape global;			// the other terms, one output per component
+
+		// Uniform grid: terms whose cutoff box touches each cell
+		static const unsigned MAX_CELLS = 64;		// per axis
+		unsigned gridN[3];
+		double gridLo[3], gridCell[3];
+		std::vector<std::vector<unsigned>> cells;
+
+		bool localTerm(const GiNaC::ex &e, const std::vector<GiNaC::symbol> &vars,
+				Term &t) const;
+		void buildIndex(void);
+
+	public:
+
+		GaussField();
+
+		// From the field components; false if there are no local terms
+		bool set(const std::vector<GiNaC::ex> &field,
+				const std::vector<GiNaC::symbol> &vars);
+
+		// d[k][i] is the component i of the derivative of order k+1 at s
+		void eval(const double s[4], double d[4][4]) const;
+
+		void clear(void) {
+			enabled = false;
+			terms.clear();
+			cells.clear();
+		}
+
+		bool isEnabled(void) const {
+			return enabled;
+		}
+
+		unsigned numLocalTerms(void) const {
+			return terms.size();
+		}
+};
@@ -0,0 +1,184 @@
+
+#include <cmath>
+#include "geometricControl.hpp"
+
+
+static inline double dot(const double a[3], const double b[3]) {
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+static inline void cross(const double a[3], const double b[3], double out[3]) {
+	out[0] = a[1]*b[2] - a[2]*b[1];
+	out[1] = a[2]*b[0] - a[0]*b[2];
+	out[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+// False if v is too short to have a direction
+static inline bool normalize(double v[3]) {
+	double n = std::sqrt(dot(v, v));
+	if (n < 1e-9) {
+		return false;
+	}
+	for (unsigned i = 0; i < 3; ++i) {
+		v[i] /= n;
+	}
+	return true;
+}
+
+static inline void column(const Mat3 &m, unsigned c, double out[3]) {
+	for (unsigned r = 0; r < 3; ++r) {
+		out[r] = m(r,c);
+	}
+}
+
+// False if m is singular
+static inline bool solve(const Mat3 &m, const double b[3], double out[3]) {
+	double c0[3], c1[3], c2[3], r[3];
+	column(m, 0, c0);
+	column(m, 1, c1);
+	column(m, 2, c2);
+	cross(c1, c2, r);
+	double det = dot(c0, r);
+	if (std::fabs(det) < 1e-12) {
+		return false;
+	}
+	// Cramer's rule: out[i] = det(m with column i replaced by b) / det
+	out[0] = dot(b, r) / det;
+	cross(c2, c0, r);
+	out[1] = dot(b, r) / det;
+	cross(c0, c1, r);
+	out[2] = dot(b, r) / det;
+	return true;
+}
+
+
+void GeometricGains::setDiagonal(const double x[3], const double v[3],
+		const double R[3], const double W[3]) {
+
+	Mat3 *k[4] = {&kx, &kv, &kR, &kW};
+	const double *diag[4] = {x, v, R, W};
+	for (unsigned n = 0; n < 4; ++n) {
+		for (unsigned r = 0; r < 3; ++r) {
+			for (unsigned c = 0; c < 3; ++c) {
+				(*k[n])(r,c) = (r == c) ? diag[n][r] : 0;
+			}
+		}
+	}
+}
+
+
+void GeometricGains::setMatrices(const double m[36]) {
+
+	Mat3 *k[4] = {&kx, &kv, &kR, &kW};
+	for (unsigned n = 0; n < 4; ++n) {
+		for (unsigned i = 0; i < 9; ++i) {
+			(*k[n])(i/3, i%3) = m[9*n + i];
+		}
+	}
+}
+
+
+void geometricControl(const GeometricGains &gains, const double J[9],
+		const SE3Target &target, const SE3State &state, double &thrust,
+		double torque[3]) {
+
+	// Force command: feed-forward m*(a_d + g*e3) = thrust * Rd*e3, with
+	//	the position and velocity errors
+	double ex[3], ev[3], kex[3], kev[3];
+	for (unsigned i = 0; i < 3; ++i) {
+		ex[i] = state.x[i] - target.x[i];
+		ev[i] = state.v[i] - target.v[i];
+	}
+	mulVec(gains.kx, ex, kex);
+	mulVec(gains.kv, ev, kev);
+
+	double b3d[3], b1d[3], b2d[3];
+	column(target.R, 2, b3d);
+	column(target.R, 0, b1d);
+	column(target.R, 1, b2d);
+
+	double force[3];
+	for (unsigned i = 0; i < 3; ++i) {
+		force[i] = target.thrust * b3d[i] - kex[i] - kev[i];
+	}
+	double b3[3];
+	column(state.R, 2, b3);
+	thrust = dot(force, b3);
+
+	// Commanded attitude: body z along the force, x towards the desired heading
+	double b3c[3] = {force[0], force[1], force[2]};
+	if (!normalize(b3c)) {
+		column(target.R, 2, b3c);
+	}
+	double b2c[3];
+	cross(b3c, b1d, b2c);
+	if (!normalize(b2c)) {
+		// Heading along the force: the desired y axis, made orthogonal
+		double p = dot(b2d, b3c);
+		for (unsigned i = 0; i < 3; ++i) {
+			b2c[i] = b2d[i] - p * b3c[i];
+		}
+		normalize(b2c);
+	}
+	double b1c[3];
+	cross(b2c, b3c, b1c);
+	Mat3 Rc;
+	for (unsigned r = 0; r < 3; ++r) {
+		Rc(r,0) = b1c[r];
+		Rc(r,1) = b2c[r];
+		Rc(r,2) = b3c[r];
+	}
+
+	// Attitude error: vee(Rc'R - R'Rc) / 2
+	Mat3 RctR = transpose(Rc) * state.R;
+	double eR[3] = {
+		(RctR(2,1) - RctR(1,2)) / 2,
+		(RctR(0,2) - RctR(2,0)) / 2,
+		(RctR(1,0) - RctR(0,1)) / 2};
+
+	// Commanded angular velocity and acceleration, in the Rc frame. Those of
+	//	Rc would need the jerk and snap of the force command: they are taken
+	//	from the desired attitude, omegaC = Rd'omega and, from the feed-
+	//	forward torque = J*dOmegaC + omegaC x J*omegaC, dOmegaC
+	Mat3 Jm;
+	for (unsigned i = 0; i < 9; ++i) {
+		Jm(i/3, i%3) = J[i];
+	}
+	double omegaC[3], JwC[3], gyroC[3], b[3], dOmegaC[3];
+	mulVec(transpose(target.R), target.omega, omegaC);
+	mulVec(Jm, omegaC, JwC);
+	cross(omegaC, JwC, gyroC);
+	for (unsigned i = 0; i < 3; ++i) {
+		b[i] = target.torque[i] - gyroC[i];
+	}
+	if (!solve(Jm, b, dOmegaC)) {
+		dOmegaC[0] = dOmegaC[1] = dOmegaC[2] = 0;
+	}
+
+	// In the body frame: R'Rc omegaC, R'Rc dOmegaC; angular velocity error
+	Mat3 RtRc = transpose(RctR);
+	double omegaD[3], dOmegaD[3], eW[3];
+	mulVec(RtRc, omegaC, omegaD);
+	mulVec(RtRc, dOmegaC, dOmegaD);
+	for (unsigned i = 0; i < 3; ++i) {
+		eW[i] = state.omega[i] - omegaD[i];
+	}
+
+	// Lee et al.: -kR eR - kW eW + omega x J omega
+	//	- J (omega^ R'Rc omegaC - R'Rc dOmegaC)
+	double Jw[3], gyro[3], wxD[3], ff[3], Jff[3];
+	mulVec(Jm, state.omega, Jw);
+	cross(state.omega, Jw, gyro);
+	cross(state.omega, omegaD, wxD);
+	for (unsigned i = 0; i < 3; ++i) {
+		ff[i] = wxD[i] - dOmegaD[i];
+	}
+	mulVec(Jm, ff, Jff);
+
+	double keR[3], keW[3];
+	mulVec(gains.kR, eR, keR);
+	mulVec(gains.kW, eW, keW);
+	for (unsigned i = 0; i < 3; ++i) {
+		torque[i] = - keR[i] - keW[i] + gyro[i] - Jff[i];
+	}
+}
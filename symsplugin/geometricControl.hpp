@@ -0,0 +1,45 @@
+// Geometric tracking controller on SE(3) (Lee, Leok, McClamroch), in fixed-
+// size doubles, vrep axes (z upwards). The torque has Lee's feed-forward
+// term -J(omega^ R'Rc omegaC - R'Rc dOmegaC), with the commanded rates of the
+// desired attitude: omegaC = Rd'omega, dOmegaC from the feed-forward torque
+
+#pragma once
+
+#include "attitude.hpp"
+
+
+struct GeometricGains {
+	Mat3 kx, kv;		// position and velocity errors
+	Mat3 kR, kW;		// attitude and angular velocity errors
+
+	// Diagonal gains, one per axis
+	void setDiagonal(const double x[3], const double v[3], const double R[3],
+			const double W[3]);
+
+	// Row-major 3x3 matrices, in order kx, kv, kR, kW
+	void setMatrices(const double m[36]);
+};
+
+
+// Desired state and feed-forward inputs; omega in the world frame
+struct SE3Target {
+	double x[3], v[3];
+	Mat3 R;
+	double omega[3];
+	double thrust;
+	double torque[3];		// body frame
+};
+
+
+// Measured state; omega in the body frame
+struct SE3State {
+	double x[3], v[3];
+	Mat3 R;
+	double omega[3];
+};
+
+
+// J: inertia matrix, row-major, body frame
+void geometricControl(const GeometricGains &gains, const double J[9],
+		const SE3Target &target, const SE3State &state, double &thrust,
+		double torque[3]);
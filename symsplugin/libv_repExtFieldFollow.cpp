@@ -3,11 +3,8 @@
 #include "libv_repExtFieldFollow.hpp"
 
 
-// #define DEBUG
-// #define DEBUG_PRINT_INIT
-// #define DEBUG_PRINT_FLAT_OUTPUTS
-// #define DEBUG_PRINT_INPUTS
-// #define DEBUG_SET_INTEGRATION
+// Debug prints and checks: see the channels in diagnostics.hpp, selected at
+//	runtime with simExtFieldFollow_diagnostics or FIELDFOLLOW_DIAG
 
 
 #define CONCAT(x,y,z) x y z
@@ -35,6 +32,7 @@ unsigned long nIter = 0;			// The number of times updateState has been called
 // dynamic properties
 float mass = 0;
 matrix J_inertia = {{1,0,0},{0,1,0},{0,0,1}};
+double J_numeric[9];		// J_inertia as doubles, set in initField()
 const float GRAVITY_G = 9.80655;
 
 
@@ -46,6 +44,9 @@ ex flatOut1[4];			// computed derivatives:
 ex flatOut2[4];
 ex flatOut3[4];
 ex flatOut4[4];
+FlatContext globalFlatContext = {{flatOut, flatOut1, flatOut2, flatOut3, flatOut4}};
+thread_local const FlatContext *flatContext = &globalFlatContext;
+std::recursive_mutex ginacMutex;	// every use of the shared GiNaC state
 
 
 // State vector defined in header
@@ -76,12 +77,53 @@ struct {
 	matrix d_R;
 	matrix dd_R;
 } equations;
+bool symbolicEquationsReady = false;	// equations are generated only if needed
 
 matrix flatOut_D1;		// vectors of symbolic flat output derivatives
 matrix flatOut_D2;
 matrix flatOut_D3;
 matrix flatOut_D4;
 
+PolyDerivatives polyDerivs;	// numeric fast path, if the field is polynomial
+bool kernelActive = false;	// FIELD_KERNEL is compiled for the loaded field
+bool kernelMapActive = false;	// and its flatness map for the current vehicle
+FieldAtlas fieldAtlas;		// several fields with regions, if loaded with initAtlas
+GaussField gaussField;		// culled localized terms, e.g. Gaussian obstacles
+LieDerivative lieDerivative;	// D2..D4 at initialization, cached partials
+ComponentDeps componentDeps;	// flat outputs of each symbolic D1..D4 component
+ExprTape fieldTape([](const ex &e) -> int {		// D1 in doubles, thread-safe
+	return e.is_equal(Sx) ? 0 : e.is_equal(Sy) ? 1 : e.is_equal(Sz) ? 2 :
+		e.is_equal(Syaw) ? 3 : -1;
+});
+unsigned fieldVersion = 0;		// incremented for each field loaded
+unsigned initWorkers = std::max(1u, std::thread::hardware_concurrency());
+		// processes for the symbolic precomputation; 1: in the plugin process
+PrecisionTier precisionTier = TIER_DOUBLE;
+ShadowStats shadowStats;		// error of the tier, on a fraction of the steps
+AsyncInit asyncInit;			// simExtFieldFollow_initAsync in progress
+string asyncShapeName;			// of the async initialization
+bool asyncResult = false;
+
+int fieldDrawingH = -1;			// arrows and streamlines in the scene
+SampleGrid drawnGrid;
+double drawnScale = 0;
+unsigned drawnSteps = 0;
+double drawnDt = 0;
+unsigned drawnVersion = 0;
+bool numericFlatnessMap = true;	// state and inputs from flatnessMap(), not equations
+bool geometricMode = false;	// updateFeedback with geometricControl(), not simpleFeedback()
+GeometricGains geometricGains;
+
+EvalMemo<State, Inputs> evalMemo;	// last evaluations, cleared with the field
+MultiRate multiRate;		// field evaluated at a lower rate, reference extrapolated
+OpCounts fieldOps[4][4];		// operations of D1..D4, [order][component]
+double fieldStepMicros = 0;		// measured time of a step, 0 if not measured
+string fieldCostReport;			// of the last initField(); empty for an atlas
+
+Diagnostics diagnostics;	// runtime debug channels, off by default
+Telemetry telemetry;		// per-step binary log, off by default
+chrono::steady_clock::time_point telemetryStart;
+
 
 // Debug variables for integration
 const float dt = 0.005;
@@ -99,26 +141,34 @@ simFloat oldVrepMatrix[12];
 // forward declaration
 void updateState(Inputs &inputs, State &state, double x, double y, double z,
 		double a, double b, double g);
+void updateState(Inputs &inputs, State &state, double x, double y, double z,
+		const Mat3 &Rvrep);
 
 /*
  Declare symbolic functions for Ginac authomatic differentiation
 */
-static ex diff_symF(const ex &var, const ex &nDiff, const ex &t, unsigned diff_param);
-static ex eval_symF(const ex &var, const ex &nDiff, const ex &t);
-static ex evalf_symF(const ex &var, const ex &nDiff, const ex &t);
+static ex diff_symF(const ex &index, const ex &nDiff, const ex &t, unsigned diff_param);
+static ex eval_symF(const ex &index, const ex &nDiff, const ex &t);
+static ex evalf_symF(const ex &index, const ex &nDiff, const ex &t);
 
-// Symbolic function for generic variables
+// Symbolic function for generic variables: symF(index, n, t) is the
+//	derivative n of the flat output FLAT_X..FLAT_YAW
 DECLARE_FUNCTION_3P(symF)
 REGISTER_FUNCTION(symF, evalf_func(evalf_symF).
 		derivative_func(diff_symF).
 		eval_func(eval_symF))
 
+static ex evalf_vehicleParam(const ex &index);
+
+// Vehicle parameters in the equations, read at evaluation:
+//	0 mass, 1..9 inertia matrix (row-major)
+DECLARE_FUNCTION_1P(vehicleParam)
+REGISTER_FUNCTION(vehicleParam, evalf_func(evalf_vehicleParam))
+
 
-static ex diff_symF(const ex &var, const ex &nDiff, const ex &t, unsigned diff_param) {
+static ex diff_symF(const ex &index, const ex &nDiff, const ex &t, unsigned diff_param) {
 	if (diff_param == 2) {
-		return symF(var, nDiff+1, t);
-	} else if (diff_param == 0) {
-		return 1;
+		return symF(index, nDiff+1, t);
 	} else {
 		cerr << "symF Bad differentiation\n" << endl;
 		return 0;
@@ -126,57 +176,79 @@ static ex diff_symF(const ex &var, const ex &nDiff, const ex &t, unsigned diff_p
 }
 
 
-static ex eval_symF(const ex &var, const ex &nDiff, const ex &t) {
+static ex eval_symF(const ex &index, const ex &nDiff, const ex &t) {
 
 	// NOTE: the first two ifs should never happen; not well tested.
 	//	How to derive the last flat outputs if the field is unspecified for them?
 	
 	// Simplify symbolic equations if the vector field do not specifies z or yaw
-	if (var.is_equal(Sz) && nVars < 3 && nDiff > 0) {
+	int i = ex_to<numeric>(index).to_int();
+	if (i == FLAT_Z && nVars < 3 && nDiff > 0) {
 		return 0;
-	} else if (var.is_equal(Syaw) && nVars < 4 && nDiff > 0) {
+	} else if (i == FLAT_YAW && nVars < 4 && nDiff > 0) {
 		return 0;
 	} else {
-		return symF(var, nDiff, t).hold();
+		return symF(index, nDiff, t).hold();
 	}
 }
 
 
-static ex evalf_symF(const ex &var, const ex &nDiff, const ex &t) {
+static ex evalf_symF(const ex &index, const ex &nDiff, const ex &t) {
 	// NOTE: flat outputs must be evaluated before any .evalf()!
+	//	They are read from the context of this thread
 
-	unsigned index = 0;
-	if (var.is_equal(Sx)) index = 0;
-	else if (var.is_equal(Sy)) index = 1;
-	else if (var.is_equal(Sz)) index = 2;
-	else if (var.is_equal(Syaw)) index = 3;
-	else {
-		cerr << "Error: wrong index in symF\n" << endl;
+	int i = ex_to<numeric>(index).to_int();
+	int n = ex_to<numeric>(nDiff).to_int();
+	if (i < FLAT_X || i > FLAT_YAW || n < 0 || n > 4) {
+		cerr << "Error: wrong argument of symF\n" << endl;
 		return 0;
 	}
+	return flatContext->values[n][i];
+}
 
-	ex ret;
-	numeric nDiffN = ex_to<numeric>(nDiff);
-	if (nDiffN == 0) {
-		ret = flatOut[index];
-	} else if (nDiffN == 1) {
-		ret = flatOut1[index];
-	} else if (nDiffN == 2) {
-		ret = flatOut2[index];
-	} else if (nDiffN == 3) {
-		ret = flatOut3[index];
-	} else if (nDiffN == 4) {
-		ret = flatOut4[index];
-	} else {
-		cerr << "Error: wrong symbol as argument of symF\n" << endl;
-		return 0;
+
+static ex evalf_vehicleParam(const ex &index) {
+
+	int i = ex_to<numeric>(index).to_int();
+	return (i == 0) ? numeric(mass) : numeric(J_numeric[i-1]);
+}
+
+
+// The inertia matrix as vehicle parameters
+static matrix symbolicInertia(void) {
+
+	matrix J(3, 3);
+	for (unsigned i = 0; i < 9; ++i) {
+		J(i/3, i%3) = vehicleParam(i+1);
 	}
+	return J;
+}
+
 
-	return ret;
+// The equations with the current vehicle parameters as numbers
+static ex bakeVehicleParams(const ex &e) {
+
+	exmap values;
+	values[vehicleParam(0)] = mass;
+	for (unsigned i = 0; i < 9; ++i) {
+		values[vehicleParam(i+1)] = J_numeric[i];
+	}
+	return e.subs(values);
 }
 
 
 
+// False, with a script error, while simExtFieldFollow_initAsync owns the field
+bool fieldIdle(const char *command) {
+
+	if (asyncInit.isRunning()) {
+		simSetLastError(command, "Field initialization in progress");
+		return false;
+	}
+	return true;
+}
+
+
 // --------------------------------------------------------------------------------------
 // simExtFieldFollow_init
 // --------------------------------------------------------------------------------------
@@ -193,7 +265,7 @@ void LUA_INIT_CALLBACK(SScriptCallBack* cb)
 { 
 	CScriptFunctionData D;
 	int ret = false;
-	if (D.readDataFromStack(cb->stackID,inArgs_INIT,inArgs_INIT[0],LUA_INIT_COMMAND))
+	if (fieldIdle(LUA_INIT_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_INIT,inArgs_INIT[0],LUA_INIT_COMMAND))
 	{
 		// fileName
 		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
@@ -212,14 +284,146 @@ void LUA_INIT_CALLBACK(SScriptCallBack* cb)
 			}
 		}
 
-		// call
+		// call; the step is measured here, not in the executable
 		ret = initField(fileName, shapeName, true);
+		if (ret) {
+			measureCost();
+		}
 	}
 	D.pushOutData(CScriptFunctionDataItem(ret));
 	D.writeDataToStack(cb->stackID);
 }
 
  
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_initAsync
+// --------------------------------------------------------------------------------------
+#define LUA_INITASYNC_COMMAND "simExtFieldFollow_initAsync"
+const int inArgs_INITASYNC[]={
+	4,
+	sim_script_arg_string,1,
+	sim_script_arg_string,1,
+	sim_script_arg_double,1,
+	sim_script_arg_table | sim_script_arg_double,9,
+};
+
+void LUA_INITASYNC_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int ticket = -1;
+	if (fieldIdle(LUA_INITASYNC_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_INITASYNC,inArgs_INITASYNC[0],LUA_INITASYNC_COMMAND))
+	{
+		// as simExtFieldFollow_init; the scene is set when the status is
+		//	polled after the end
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		string fileName = inData->at(0).stringData[0];
+		asyncShapeName = inData->at(1).stringData[0];
+		mass = inData->at(2).doubleData[0];
+		for (unsigned r = 0; r < 3; ++r) {
+			for (unsigned c = 0; c < 3; ++c) {
+				J_inertia(r,c) = inData->at(3).doubleData[r*3+c];
+			}
+		}
+
+		// call
+		// An exception would terminate the worker thread, and V-REP with it:
+		//	e.g. GiNaC's parse_error on a malformed field line
+		ticket = asyncInit.start([fileName]() {
+			try {
+				return initField(fileName, "", false) != 0;
+			} catch (exception &e) {
+				cerr << "FieldFollow: initialization of " << fileName << ": " <<
+					e.what() << endl;
+				return false;
+			}
+		});
+	}
+	D.pushOutData(CScriptFunctionDataItem(ticket));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_initStatus
+// --------------------------------------------------------------------------------------
+#define LUA_INITSTATUS_COMMAND "simExtFieldFollow_initStatus"
+const int inArgs_INITSTATUS[]={
+	1,
+	sim_script_arg_int32,0,
+};
+
+void LUA_INITSTATUS_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	string stage = "unknown";
+	double progress = 0;
+	bool ready = false;
+	bool ok = false;
+	if (D.readDataFromStack(cb->stackID,inArgs_INITSTATUS,inArgs_INITSTATUS[0],LUA_INITSTATUS_COMMAND))
+	{
+		int ticket = D.getInDataPtr()->at(0).int32Data[0];
+		if (asyncInit.isCurrent(ticket)) {
+
+			// Finished: the initial state is set here, in the simulation thread
+			if (asyncInit.isFinished(ticket) && asyncInit.isPending()) {
+				asyncResult = asyncInit.finish();
+				if (asyncResult) {
+					setVrepInitialState(asyncShapeName);
+					measureCost();
+				}
+			}
+			stage = initStageName(asyncInit.getStage());
+			progress = asyncInit.getProgress();
+			ready = asyncInit.isFinished(ticket);
+			ok = ready && asyncResult;
+		}
+	}
+	// stage name, progress 0..1, ready, initialization result
+	D.pushOutData(CScriptFunctionDataItem(stage));
+	D.pushOutData(CScriptFunctionDataItem(progress));
+	D.pushOutData(CScriptFunctionDataItem(ready));
+	D.pushOutData(CScriptFunctionDataItem(ok));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_initAtlas
+// --------------------------------------------------------------------------------------
+#define LUA_INITATLAS_COMMAND "simExtFieldFollow_initAtlas"
+const int inArgs_INITATLAS[]={
+	4,
+	sim_script_arg_string,1,
+	sim_script_arg_string,1,
+	sim_script_arg_double,1,
+	sim_script_arg_table | sim_script_arg_double,9,
+};
+
+void LUA_INITATLAS_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int ret = false;
+	if (fieldIdle(LUA_INITATLAS_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_INITATLAS,inArgs_INITATLAS[0],LUA_INITATLAS_COMMAND))
+	{
+		// atlas file, shape name, mass, inertia matrix: as simExtFieldFollow_init
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		string fileName = inData->at(0).stringData[0];
+		string shapeName = inData->at(1).stringData[0];
+		mass = inData->at(2).doubleData[0];
+		for (unsigned r = 0; r < 3; ++r) {
+			for (unsigned c = 0; c < 3; ++c) {
+				J_inertia(r,c) = inData->at(3).doubleData[r*3+c];
+			}
+		}
+
+		// call
+		ret = initAtlas(fileName, shapeName, true);
+	}
+	D.pushOutData(CScriptFunctionDataItem(ret));
+	D.writeDataToStack(cb->stackID);
+}
+
+
 // --------------------------------------------------------------------------------------
 // simExtFieldFollow_update
 // --------------------------------------------------------------------------------------
@@ -233,8 +437,8 @@ const int inArgs_UPDATE[]={
 void LUA_UPDATE_CALLBACK(SScriptCallBack* cb)
 { 
 	CScriptFunctionData D;
-	Inputs inputs;
-	if (D.readDataFromStack(cb->stackID,inArgs_UPDATE,inArgs_UPDATE[0],LUA_UPDATE_COMMAND))
+	Inputs inputs = {0, 0, 0, 0};
+	if (fieldIdle(LUA_UPDATE_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_UPDATE,inArgs_UPDATE[0],LUA_UPDATE_COMMAND))
 	{
 		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
 		double x = inData->at(0).doubleData[0];
@@ -274,8 +478,8 @@ const int inArgs_UPDATEFEEDBACK[]={
 void LUA_UPDATEFEEDBACK_CALLBACK(SScriptCallBack* cb)
 { 
 	CScriptFunctionData D;
-	Inputs inputs;
-	if (D.readDataFromStack(cb->stackID,inArgs_UPDATEFEEDBACK,inArgs_UPDATEFEEDBACK[0],LUA_UPDATE_COMMAND))
+	Inputs inputs = {0, 0, 0, 0};
+	if (fieldIdle(LUA_UPDATEFEEDBACK_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_UPDATEFEEDBACK,inArgs_UPDATEFEEDBACK[0],LUA_UPDATE_COMMAND))
 	{
 		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
 		double x = inData->at(0).doubleData[0];
@@ -297,23 +501,606 @@ void LUA_UPDATEFEEDBACK_CALLBACK(SScriptCallBack* cb)
 
 		// call
 		State state;
-		updateState(inputs, state, x, y, z, a, b, g);
+		Mat3 R = abg2mat(a, b, g);
+		updateState(inputs, state, x, y, z, R);
+
+		if (nIter > 4) {
+			const double xyz[] = {x, y, z};
+			const double v[] = {vx, vy, vz};
+			const double omega[] = {omegax, omegay, omegaz};
+			const double gains[] = {gainsx, gainsa, gainsv, gainso};
+			if (geometricMode) {
+				geometricFeedback(inputs, state, xyz, R, v, omega);
+			} else {
+				simpleFeedback(inputs, state, xyz, R, v, omega, gains);
+			}
+		}
+	}
+
+	// return quadrotor inputs
+	D.pushOutData(CScriptFunctionDataItem(inputs.fz));
+	D.pushOutData(CScriptFunctionDataItem(inputs.tx));
+	D.pushOutData(CScriptFunctionDataItem(inputs.ty));
+	D.pushOutData(CScriptFunctionDataItem(inputs.tz));
+	D.writeDataToStack(cb->stackID);
+}
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_updateQuaternion
+// --------------------------------------------------------------------------------------
+#define LUA_UPDATEQUATERNION_COMMAND "simExtFieldFollow_updateQuaternion"
+const int inArgs_UPDATEQUATERNION[]={
+	2,
+	sim_script_arg_table | sim_script_arg_double,3,
+	sim_script_arg_table | sim_script_arg_double,4,
+};
+
+void LUA_UPDATEQUATERNION_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	Inputs inputs = {0, 0, 0, 0};
+	State state;
+	state.R = abg2mat(0, 0, 0);
+	if (fieldIdle(LUA_UPDATEQUATERNION_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_UPDATEQUATERNION,inArgs_UPDATEQUATERNION[0],LUA_UPDATEQUATERNION_COMMAND))
+	{
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		const vector<double> &xyz = inData->at(0).doubleData;
+		const vector<double> &q = inData->at(1).doubleData;
+
+		// call
+		updateState(inputs, state, xyz[0], xyz[1], xyz[2],
+				quat2mat(Quat{q[0], q[1], q[2], q[3]}));
+	}
+
+	// return quadrotor inputs and the desired attitude
+	Quat qDes = mat2quat(state.R);
+	D.pushOutData(CScriptFunctionDataItem(inputs.fz));
+	D.pushOutData(CScriptFunctionDataItem(inputs.tx));
+	D.pushOutData(CScriptFunctionDataItem(inputs.ty));
+	D.pushOutData(CScriptFunctionDataItem(inputs.tz));
+	D.pushOutData(CScriptFunctionDataItem(vector<double>{qDes.x, qDes.y, qDes.z, qDes.w}));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_updateMatrix
+// --------------------------------------------------------------------------------------
+#define LUA_UPDATEMATRIX_COMMAND "simExtFieldFollow_updateMatrix"
+const int inArgs_UPDATEMATRIX[]={
+	1,
+	sim_script_arg_table | sim_script_arg_double,12,
+};
+
+void LUA_UPDATEMATRIX_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	Inputs inputs = {0, 0, 0, 0};
+	State state;
+	state.R = abg2mat(0, 0, 0);
+	if (fieldIdle(LUA_UPDATEMATRIX_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_UPDATEMATRIX,inArgs_UPDATEMATRIX[0],LUA_UPDATEMATRIX_COMMAND))
+	{
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		double pos[3];
+		Mat3 R = vrepPose2mat(inData->at(0).doubleData.data(), pos);
+
+		// call
+		updateState(inputs, state, pos[0], pos[1], pos[2], R);
+	}
+
+	// return quadrotor inputs and the desired pose
+	vector<double> desPose(12);
+	const double desPos[] = {state.x, state.y, state.z};
+	mat2vrepPose(state.R, desPos, desPose.data());
+	D.pushOutData(CScriptFunctionDataItem(inputs.fz));
+	D.pushOutData(CScriptFunctionDataItem(inputs.tx));
+	D.pushOutData(CScriptFunctionDataItem(inputs.ty));
+	D.pushOutData(CScriptFunctionDataItem(inputs.tz));
+	D.pushOutData(CScriptFunctionDataItem(desPose));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_updateFeedbackQuaternion
+// --------------------------------------------------------------------------------------
+#define LUA_UPDATEFEEDBACKQUATERNION_COMMAND "simExtFieldFollow_updateFeedbackQuaternion"
+const int inArgs_UPDATEFEEDBACKQUATERNION[]={
+	5,
+	sim_script_arg_table | sim_script_arg_double,3,
+	sim_script_arg_table | sim_script_arg_double,4,
+	sim_script_arg_table | sim_script_arg_double,3,
+	sim_script_arg_table | sim_script_arg_double,3,
+	sim_script_arg_table | sim_script_arg_double,4,
+};
+
+void LUA_UPDATEFEEDBACKQUATERNION_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	Inputs inputs = {0, 0, 0, 0};
+	if (fieldIdle(LUA_UPDATEFEEDBACKQUATERNION_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_UPDATEFEEDBACKQUATERNION,inArgs_UPDATEFEEDBACKQUATERNION[0],LUA_UPDATEFEEDBACKQUATERNION_COMMAND))
+	{
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		const double *xyz = inData->at(0).doubleData.data();
+		const vector<double> &q = inData->at(1).doubleData;
+		const double *v = inData->at(2).doubleData.data();
+		const double *omega = inData->at(3).doubleData.data();
+		const double *gains = inData->at(4).doubleData.data();
+
+		// call
+		State state;
+		Mat3 R = quat2mat(Quat{q[0], q[1], q[2], q[3]});
+		updateState(inputs, state, xyz[0], xyz[1], xyz[2], R);
+
+		if (nIter > 4) {
+			if (geometricMode) {
+				geometricFeedback(inputs, state, xyz, R, v, omega);
+			} else {
+				simpleFeedback(inputs, state, xyz, R, v, omega, gains);
+			}
+		}
+	}
+
+	// return quadrotor inputs
+	D.pushOutData(CScriptFunctionDataItem(inputs.fz));
+	D.pushOutData(CScriptFunctionDataItem(inputs.tx));
+	D.pushOutData(CScriptFunctionDataItem(inputs.ty));
+	D.pushOutData(CScriptFunctionDataItem(inputs.tz));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_telemetry
+// --------------------------------------------------------------------------------------
+#define LUA_TELEMETRY_COMMAND "simExtFieldFollow_telemetry"
+const int inArgs_TELEMETRY[]={
+	1,
+	sim_script_arg_string,1,
+};
+
+void LUA_TELEMETRY_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int ret = false;
+	if (D.readDataFromStack(cb->stackID,inArgs_TELEMETRY,inArgs_TELEMETRY[0],LUA_TELEMETRY_COMMAND))
+	{
+		// log file; empty to stop logging
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		string fileName = inData->at(0).stringData[0];
+
+		if (fileName.empty()) {
+			telemetry.stop();
+			ret = true;
+		} else {
+			telemetryStart = chrono::steady_clock::now();
+			ret = telemetry.start(fileName);
+		}
+	}
+	D.pushOutData(CScriptFunctionDataItem(ret));
+	D.writeDataToStack(cb->stackID);
+}
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_diagnostics
+// --------------------------------------------------------------------------------------
+#define LUA_DIAGNOSTICS_COMMAND "simExtFieldFollow_diagnostics"
+const int inArgs_DIAGNOSTICS[]={
+	1,
+	sim_script_arg_string,1,
+};
+
+void LUA_DIAGNOSTICS_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int ret = false;
+	if (D.readDataFromStack(cb->stackID,inArgs_DIAGNOSTICS,inArgs_DIAGNOSTICS[0],LUA_DIAGNOSTICS_COMMAND))
+	{
+		// comma separated channels: init, flatOutputs, inputs, integration,
+		//	setIntegration; "all" turns on all but setIntegration, "" turns all off
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		ret = diagnostics.setChannels(inData->at(0).stringData[0]);
+	}
+	D.pushOutData(CScriptFunctionDataItem(ret));
+	D.writeDataToStack(cb->stackID);
+}
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_setFlatnessMap
+// --------------------------------------------------------------------------------------
+#define LUA_SETFLATNESSMAP_COMMAND "simExtFieldFollow_setFlatnessMap"
+const int inArgs_SETFLATNESSMAP[]={
+	1,
+	sim_script_arg_string,1,
+};
+
+void LUA_SETFLATNESSMAP_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int ret = false;
+	if (fieldIdle(LUA_SETFLATNESSMAP_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_SETFLATNESSMAP,inArgs_SETFLATNESSMAP[0],LUA_SETFLATNESSMAP_COMMAND))
+	{
+		// "numeric" (default) or "symbolic"
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		string mode = inData->at(0).stringData[0];
+		if (mode == "numeric" || mode == "symbolic") {
+			numericFlatnessMap = (mode == "numeric");
+			evalMemo.clear();
+			ret = true;
+		}
+	}
+	D.pushOutData(CScriptFunctionDataItem(ret));
+	D.writeDataToStack(cb->stackID);
+}
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_setFeedback
+// --------------------------------------------------------------------------------------
+#define LUA_SETFEEDBACK_COMMAND "simExtFieldFollow_setFeedback"
+const int inArgs_SETFEEDBACK[]={
+	2,
+	sim_script_arg_string,1,
+	sim_script_arg_table | sim_script_arg_double,0,
+};
+
+void LUA_SETFEEDBACK_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int ret = false;
+	if (fieldIdle(LUA_SETFEEDBACK_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_SETFEEDBACK,inArgs_SETFEEDBACK[0],LUA_SETFEEDBACK_COMMAND))
+	{
+		// "simple" (default: the gains of updateFeedback) or "geometric"
+		//	with gains kx, kv, kR, kw: 12 diagonals or 36 row-major matrices
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		string mode = inData->at(0).stringData[0];
+		const vector<double> &gains = inData->at(1).doubleData;
+		if (mode == "simple") {
+			geometricMode = false;
+			ret = true;
+		} else if (mode == "geometric" && gains.size() == 12) {
+			geometricGains.setDiagonal(&gains[0], &gains[3], &gains[6], &gains[9]);
+			geometricMode = true;
+			ret = true;
+		} else if (mode == "geometric" && gains.size() == 36) {
+			geometricGains.setMatrices(gains.data());
+			geometricMode = true;
+			ret = true;
+		}
+	}
+	D.pushOutData(CScriptFunctionDataItem(ret));
+	D.writeDataToStack(cb->stackID);
+}
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_sampleField
+// --------------------------------------------------------------------------------------
+#define LUA_SAMPLEFIELD_COMMAND "simExtFieldFollow_sampleField"
+const int inArgs_SAMPLEFIELD[]={
+	7,
+	sim_script_arg_table | sim_script_arg_double,3,
+	sim_script_arg_table | sim_script_arg_double,3,
+	sim_script_arg_table | sim_script_arg_int32,3,
+	sim_script_arg_int32,0,
+	sim_script_arg_double,0,
+	sim_script_arg_int32,0,
+	sim_script_arg_double,0,
+};
+
+// Read lo, hi, counts and yaw of a grid from the first arguments
+SampleGrid readSampleGrid(std::vector<CScriptFunctionDataItem>* inData, double yaw) {
+
+	SampleGrid grid;
+	for (unsigned i = 0; i < 3; ++i) {
+		grid.lo[i] = inData->at(0).doubleData[i];
+		grid.hi[i] = inData->at(1).doubleData[i];
+		grid.n[i] = std::max(inData->at(2).int32Data[i], 0);
+	}
+	grid.yaw = yaw;
+	return grid;
+}
+
+void LUA_SAMPLEFIELD_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	vector<double> derivs, lines;
+	bool ok = false;
+	if (fieldIdle(LUA_SAMPLEFIELD_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_SAMPLEFIELD,inArgs_SAMPLEFIELD[0],LUA_SAMPLEFIELD_COMMAND))
+	{
+		// lo, hi, counts (vrep coordinates), orders (1..4), yaw,
+		//	streamline steps (0: none) and time step
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		SampleGrid grid = readSampleGrid(inData, inData->at(4).doubleData[0]);
+		int orders = inData->at(3).int32Data[0];
+		int steps = inData->at(5).int32Data[0];
+		double dt = inData->at(6).doubleData[0];
+
+		// call
+		if (!canSampleField()) {
+			simSetLastError(LUA_SAMPLEFIELD_COMMAND, "Field not supported by the numeric evaluators.");
+		} else if (orders < 1 || orders > 4) {
+			simSetLastError(LUA_SAMPLEFIELD_COMMAND, "Orders must be 1 to 4.");
+		} else if (steps < 0) {
+			simSetLastError(LUA_SAMPLEFIELD_COMMAND, "Streamline steps must not be negative.");
+		} else {
+			sampleField(grid, orders, sampleDerivativesVrep, derivs);
+			if (steps > 0) {
+				traceStreamlines(grid, steps, dt, sampleDerivativesVrep, lines);
+			}
+			ok = true;
+		}
+	}
+
+	// derivs[(p*orders + k)*4 + i], lines[(p*(steps+1) + j)*3 + i]; nil
+	//	on errors
+	if (ok) {
+		D.pushOutData(CScriptFunctionDataItem(derivs));
+		D.pushOutData(CScriptFunctionDataItem(lines));
+	}
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_drawField
+// --------------------------------------------------------------------------------------
+#define LUA_DRAWFIELD_COMMAND "simExtFieldFollow_drawField"
+const int inArgs_DRAWFIELD[]={
+	6,
+	sim_script_arg_table | sim_script_arg_double,3,
+	sim_script_arg_table | sim_script_arg_double,3,
+	sim_script_arg_table | sim_script_arg_int32,3,
+	sim_script_arg_double,0,
+	sim_script_arg_int32,0,
+	sim_script_arg_double,0,
+};
+
+void LUA_DRAWFIELD_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int handle = -1;
+	if (fieldIdle(LUA_DRAWFIELD_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_DRAWFIELD,inArgs_DRAWFIELD[0],LUA_DRAWFIELD_COMMAND))
+	{
+		// lo, hi, counts (0 removes the drawing), arrow scale,
+		//	streamline steps and time step. Drawn at yaw 0
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		SampleGrid grid = readSampleGrid(inData, 0);
+		double scale = inData->at(3).doubleData[0];
+		int steps = std::max(inData->at(4).int32Data[0], 0);
+		double dt = inData->at(5).doubleData[0];
+
+		// call
+		handle = drawField(grid, scale, steps, dt);
+	}
+	D.pushOutData(CScriptFunctionDataItem(handle));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_setInitWorkers
+// --------------------------------------------------------------------------------------
+#define LUA_SETINITWORKERS_COMMAND "simExtFieldFollow_setInitWorkers"
+const int inArgs_SETINITWORKERS[]={
+	1,
+	sim_script_arg_int32,0,
+};
+
+void LUA_SETINITWORKERS_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	if (fieldIdle(LUA_SETINITWORKERS_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_SETINITWORKERS,inArgs_SETINITWORKERS[0],LUA_SETINITWORKERS_COMMAND))
+	{
+		// forked processes for the symbolic derivatives at the next init;
+		//	0 or 1: computed in the plugin process
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		initWorkers = std::max(1, inData->at(0).int32Data[0]);
+	}
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_setPrecision
+// --------------------------------------------------------------------------------------
+#define LUA_SETPRECISION_COMMAND "simExtFieldFollow_setPrecision"
+const int inArgs_SETPRECISION[]={
+	2,
+	sim_script_arg_string,0,
+	sim_script_arg_double,0,
+};
+
+void LUA_SETPRECISION_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int ret = false;
+	if (fieldIdle(LUA_SETPRECISION_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_SETPRECISION,inArgs_SETPRECISION[0],LUA_SETPRECISION_COMMAND))
+	{
+		// "float", "double" (default) or "exact"; fraction of the steps
+		//	evaluated again at the next tier (0: no shadow)
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		PrecisionTier tier;
+		if (!parsePrecisionTier(inData->at(0).stringData[0], tier)) {
+			simSetLastError(LUA_SETPRECISION_COMMAND, "Unknown tier.");
+		} else if (tier == TIER_EXACT && fieldAtlas.isEnabled()) {
+			simSetLastError(LUA_SETPRECISION_COMMAND, "The exact tier needs the symbolic derivatives of a single field, not an atlas.");
+		} else {
+			precisionTier = tier;
+			shadowStats.reset(inData->at(1).doubleData[0]);
+			evalMemo.clear();
+			ret = true;
+			if (!reportTierFallback()) {
+				simSetLastError(LUA_SETPRECISION_COMMAND, "The float tier needs the expression tape of a single field: evaluating in double.");
+			}
+		}
+	}
+	D.pushOutData(CScriptFunctionDataItem(ret));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_getShadowStats
+// --------------------------------------------------------------------------------------
+#define LUA_GETSHADOWSTATS_COMMAND "simExtFieldFollow_getShadowStats"
+
+void LUA_GETSHADOWSTATS_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+
+	// shadow steps, max relative error on the inputs, step of the max
+	D.pushOutData(CScriptFunctionDataItem((double)shadowStats.samples));
+	D.pushOutData(CScriptFunctionDataItem(shadowStats.maxRelError));
+	D.pushOutData(CScriptFunctionDataItem((double)shadowStats.worstStep));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_setMultiRate
+// --------------------------------------------------------------------------------------
+#define LUA_SETMULTIRATE_COMMAND "simExtFieldFollow_setMultiRate"
+const int inArgs_SETMULTIRATE[]={
+	2,
+	sim_script_arg_int32,0,
+	sim_script_arg_double,0,
+};
+
+void LUA_SETMULTIRATE_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int ret = false;
+	if (fieldIdle(LUA_SETMULTIRATE_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_SETMULTIRATE,inArgs_SETMULTIRATE[0],LUA_SETMULTIRATE_COMMAND))
+	{
+		// steps per field evaluation (1 disables), max drift of the
+		//	extrapolated x, y, z, yaw from the measured ones
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		int ratio = inData->at(0).int32Data[0];
+		double tolerance = inData->at(1).doubleData[0];
+		if (ratio >= 1 && tolerance >= 0) {
+			multiRate.configure(ratio, tolerance);
+			ret = true;
+		}
+	}
+	D.pushOutData(CScriptFunctionDataItem(ret));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_getMultiRateStats
+// --------------------------------------------------------------------------------------
+#define LUA_GETMULTIRATESTATS_COMMAND "simExtFieldFollow_getMultiRateStats"
+
+void LUA_GETMULTIRATESTATS_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+
+	// field evaluations, extrapolated steps, evaluations forced by the drift
+	D.pushOutData(CScriptFunctionDataItem((double)multiRate.getAnchors()));
+	D.pushOutData(CScriptFunctionDataItem((double)multiRate.getExtrapolated()));
+	D.pushOutData(CScriptFunctionDataItem((double)multiRate.getForced()));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_exprProfile
+// --------------------------------------------------------------------------------------
+#define LUA_EXPRPROFILE_COMMAND "simExtFieldFollow_exprProfile"
+const int inArgs_EXPRPROFILE[]={
+	1,
+	sim_script_arg_bool,0,
+};
+
+void LUA_EXPRPROFILE_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	string report;
+	if (fieldIdle(LUA_EXPRPROFILE_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_EXPRPROFILE,inArgs_EXPRPROFILE[0],LUA_EXPRPROFILE_COMMAND))
+	{
+		// true: share the equal subtrees of the expressions first
+		bool compact = D.getInDataPtr()->at(0).boolData[0];
+		report = derivedExpressionsReport(compact);
+	}
+	D.pushOutData(CScriptFunctionDataItem(report));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_getCostReport
+// --------------------------------------------------------------------------------------
+#define LUA_GETCOSTREPORT_COMMAND "simExtFieldFollow_getCostReport"
+const int inArgs_GETCOSTREPORT[]={
+	1,
+	sim_script_arg_bool,0,
+};
+
+void LUA_GETCOSTREPORT_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	if (fieldIdle(LUA_GETCOSTREPORT_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_GETCOSTREPORT,inArgs_GETCOSTREPORT[0],LUA_GETCOSTREPORT_COMMAND))
+	{
+		// true: measure the step, at the current tier
+		bool recalibrate = D.getInDataPtr()->at(0).boolData[0];
+		if (recalibrate && !fieldCostReport.empty() && !measureCost()) {
+			simSetLastError(LUA_GETCOSTREPORT_COMMAND, "Step measurement failed");
+		}
+	}
+	D.pushOutData(CScriptFunctionDataItem(fieldCostReport));
+	D.pushOutData(CScriptFunctionDataItem(fieldStepMicros));
+	D.writeDataToStack(cb->stackID);
+}
+
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_setMemo
+// --------------------------------------------------------------------------------------
+#define LUA_SETMEMO_COMMAND "simExtFieldFollow_setMemo"
+const int inArgs_SETMEMO[]={
+	1,
+	sim_script_arg_int32,0,
+};
+
+void LUA_SETMEMO_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int ret = false;
+	if (fieldIdle(LUA_SETMEMO_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_SETMEMO,inArgs_SETMEMO[0],LUA_SETMEMO_COMMAND))
+	{
+		// entries (0 disables, at most CAPACITY)
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		int entries = inData->at(0).int32Data[0];
+		if (entries >= 0) {
+			evalMemo.configure(entries);
+			ret = true;
+		}
+	}
+	D.pushOutData(CScriptFunctionDataItem(ret));
+	D.writeDataToStack(cb->stackID);
+}
+
+// --------------------------------------------------------------------------------------
+// simExtFieldFollow_setVehicleParams
+// --------------------------------------------------------------------------------------
+#define LUA_SETVEHICLEPARAMS_COMMAND "simExtFieldFollow_setVehicleParams"
+const int inArgs_SETVEHICLEPARAMS[]={
+	2,
+	sim_script_arg_double,0,
+	sim_script_arg_table | sim_script_arg_double,9,
+};
 
-		if (nIter > 4) {
-			simpleFeedback(inputs, state,
-					matrix{{x},{y},{z}},
-					matrix{{a},{b},{g}},
-					matrix{{vx},{vy},{vz}},
-					matrix{{omegax},{omegay},{omegaz}},
-					matrix{{gainsx},{gainsa},{gainsv},{gainso}});
-		}
+void LUA_SETVEHICLEPARAMS_CALLBACK(SScriptCallBack* cb)
+{
+	CScriptFunctionData D;
+	int ret = false;
+	if (fieldIdle(LUA_SETVEHICLEPARAMS_COMMAND) && D.readDataFromStack(cb->stackID,inArgs_SETVEHICLEPARAMS,inArgs_SETVEHICLEPARAMS[0],LUA_SETVEHICLEPARAMS_COMMAND))
+	{
+		// mass, inertia matrix: as simExtFieldFollow_init, between steps
+		std::vector<CScriptFunctionDataItem>* inData=D.getInDataPtr();
+		ret = setVehicleParams(inData->at(0).doubleData[0], inData->at(1).doubleData.data());
 	}
-
-	// return quadrotor inputs
-	D.pushOutData(CScriptFunctionDataItem(inputs.fz));
-	D.pushOutData(CScriptFunctionDataItem(inputs.tx));
-	D.pushOutData(CScriptFunctionDataItem(inputs.ty));
-	D.pushOutData(CScriptFunctionDataItem(inputs.tz));
+	D.pushOutData(CScriptFunctionDataItem(ret));
 	D.writeDataToStack(cb->stackID);
 }
 
@@ -547,21 +1334,186 @@ matrix abgRate2omegaVrep(matrix abgRate, matrix abg) {
 // >>> end of the utility functions
 
 
-// given the vector of the variables, the symbolic vector src in inputs
-// computes the next derivative through dv/dt = J_v(x) * dx/dt
+// Runs the tasks in worker processes if enabled, else (or if that fails) here;
+//	the fraction of the tasks done is the progress of the stage
+vector<exvector> runInitTasks(const vector<SymbolicTask> &tasks) {
+
+	auto done = [&tasks](unsigned n) {
+		asyncInit.setStageProgress((double)n / tasks.size());
+	};
+	vector<exvector> results;
+	if (initWorkers > 1 && runSymbolicTasks(tasks, lst{Sx, Sy, Sz, Syaw, St},
+			initWorkers, results, done)) {
+		return results;
+	}
+	results.clear();
+	for (const SymbolicTask &task : tasks) {
+		results.push_back(task());
+		done(results.size());
+	}
+	return results;
+}
+
+
+// D2..D4 from D1. The next derivative is dv/dt = J_v(x) * dx/dt, the Lie
+//	derivative of v along dx/dt = D1, so each component depends only on the
+//	same component of the previous order: one task per component computes
+//	all its orders
 //	NOTE: This is different from the reference paper! They wrote dv/dt = J_v(x) * v
-void genNextDerivative(const vector <symbol> vars, const matrix& src,
-		const matrix& dx, matrix& dest) {
+void genDerivatives(const vector <symbol> &vars) {
+
+	matrix *orders[] = {&flatOut_D1, &flatOut_D2, &flatOut_D3, &flatOut_D4};
+	asyncInit.setStage(INIT_DERIVATIVES);
+
+	// The workers inherit the partials of D1; the partials of each order are
+	//	reused by the next one in the same task. A task returns D2..D4, and
+	//	the partials it cached and its cache hits
+	lieDerivative.set(vars, {flatOut_D1(0,0), flatOut_D1(1,0), flatOut_D1(2,0),
+			flatOut_D1(3,0)});
+	const size_t sharedPartials = lieDerivative.cacheSize();
+	const unsigned long long sharedHits = lieDerivative.cacheHits();
+
+	vector<SymbolicTask> tasks;
+	for (unsigned i = 0; i < 4; ++i) {
+		tasks.push_back([i]() {
+			size_t partials = lieDerivative.cacheSize();
+			unsigned long long hits = lieDerivative.cacheHits();
+			exvector chain;
+			ex v = flatOut_D1(i,0);
+			for (unsigned k = 1; k < 4; ++k) {
+				v = lieDerivative.next(v);
+				chain.push_back(v);
+			}
+			chain.push_back(numeric((long)(lieDerivative.cacheSize() - partials)));
+			chain.push_back(numeric((long)(lieDerivative.cacheHits() - hits)));
+			return chain;
+		});
+	}
+	vector<exvector> res = runInitTasks(tasks);
+
+	for (unsigned k = 1; k < 4; ++k) {
+		*orders[k] = matrix(4, 1);
+		for (unsigned i = 0; i < 4; ++i) {
+			(*orders[k])(i,0) = res[i][k-1];
+		}
+	}
+
+	// In this process the counts are already in the cache
+	if (lieDerivative.cacheSize() == sharedPartials &&
+			lieDerivative.cacheHits() == sharedHits) {
+		for (unsigned i = 0; i < 4; ++i) {
+			lieDerivative.addWorkerStats(ex_to<numeric>(res[i][3]).to_long(),
+					ex_to<numeric>(res[i][4]).to_long());
+		}
+	}
+}
+
+
+void paper2vrepState(State &state, const double in[20], const double out[9]) {
+
+	// State in vrep convention, in doubles
+	//	in: flat outputs and derivatives, as the kernel inputs
+	//	out: phi, theta, omega (global), u_torque, u_thrust in paper convention
+
+	state.x = in[0];
+	state.y = -in[1];
+	state.z = -in[2];
+	state.vx = in[4];
+	state.vy = -in[5];
+	state.vz = -in[6];
+
+	// The attitude is a rotation matrix; abg only for the old interface
+	state.R = vrepTransform(rpy2mat(out[0], out[1], in[3]));
+	double abg[3];
+	mat2abg(state.R, abg);
+	state.a = abg[0];
+	state.b = abg[1];
+	state.g = abg[2];
+
+	state.p = out[2];
+	state.q = -out[3];
+	state.r = -out[4];
+}
+
+
+void numericPaper2vrep(State &state, Inputs &inputs, const double in[20],
+		const double out[9]) {
+
+	// Same conversions of flatOutputs2state() and flatOutputs2inputs(), in doubles
+	paper2vrepState(state, in, out);
+
+	inputs.tx = out[5];
+	inputs.ty = -out[6];
+	inputs.tz = -out[7];
+	inputs.fz = (out[8] > 0) ? out[8] : 0;		// can't provide negative thrust
+}
+
+
+bool kernelMatches(const string &fieldText) {
 
-	unsigned nVars = vars.size();
-	matrix jacob(nVars, nVars);
-	for (unsigned r = 0; r < nVars; ++r) {
-		for (unsigned c = 0; c < nVars; ++c) {
-			jacob(r, c) = src[r].diff(vars.at(c));
+	// The compiled kernel is used only for its field, by content: an edited
+	//	file has to be compiled again
+#ifdef FIELD_KERNEL
+	return fieldContentHash(fieldText) == FieldKernel::fieldHash;
+#else
+	return false;
+#endif
+}
+
+
+bool kernelVehicleMatches(void) {
+
+	// The compiled flatness map is used only for its vehicle
+#ifdef FIELD_KERNEL
+	if (fabs(mass - FieldKernel::mass) > 1e-6) {
+		return false;
+	}
+	for (unsigned r = 0; r < 3; ++r) {
+		for (unsigned c = 0; c < 3; ++c) {
+			if (fabs(EX_TO_DOUBLE(J_inertia(r,c)) - FieldKernel::J(r,c)) > 1e-6) {
+				return false;
+			}
 		}
 	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void numericFlatOutputs(State &state, Inputs &inputs, const double s[4],
+		const double d[4][4]) {
+
+	// Numeric flatness map: only the field derivatives are symbolic
+	double in[20];
+	std::copy(s, s+4, in);
+	std::copy(&d[0][0], &d[0][0]+16, in+4);
 
-	dest = jacob.mul(dx);
+	double out[9];
+	flatnessMap(in, mass, J_numeric, GRAVITY_G, out);
+	numericPaper2vrep(state, inputs, in, out);
+}
+
+
+void kernelDerivatives(const double s[4], double d[4][4]) {
+#ifdef FIELD_KERNEL
+	kernelDerivatives<FieldKernel>(s, d);
+#endif
+}
+
+
+void kernelFlatOutputs(State &state, Inputs &inputs, const double s[4],
+		const double d[4][4]) {
+#ifdef FIELD_KERNEL
+	double in[20];
+	std::copy(s, s+4, in);
+	std::copy(&d[0][0], &d[0][0]+16, in+4);
+
+	double out[9];
+	kernelFlatnessMap<FieldKernel>(in, out);
+	numericPaper2vrep(state, inputs, in, out);
+#endif
 }
 
 
@@ -572,44 +1524,30 @@ void flatOutputs2state(State &state) {
 	// Endogenous transformation: state in paper, eq.8
 	// state: x, y, z, vx , vy , vz , psi, theta, phi, p, q, r
 
-	ex x = flatOut[0];
-	ex y = flatOut[1];
-	ex z = flatOut[2];
+	const FlatContext &c = *flatContext;
+	ex x = c.values[0][FLAT_X];
+	ex y = c.values[0][FLAT_Y];
+	ex z = c.values[0][FLAT_Z];
 
-	ex vx = flatOut1[0];
-	ex vy = flatOut1[1];
-	ex vz = flatOut1[2];
+	ex vx = c.values[1][FLAT_X];
+	ex vy = c.values[1][FLAT_Y];
+	ex vz = c.values[1][FLAT_Z];
 
 	ex phi = equations.phi.evalf();
 	ex theta = equations.theta.evalf();
-	ex psi = flatOut[3];
+	ex psi = c.values[0][FLAT_YAW];
 
 	ex omegaGlobal = equations.R * equations.omega;
 	matrix omegaGlobalM = ex_to<matrix>(omegaGlobal.evalm().evalf());
 
 	// Transform to Vrep convention
-	matrix vTemp = vectorVrepTransform(matrix({{x},{y},{z}}));
-	state.x = EX_TO_DOUBLE(vTemp(0,0));
-	state.y = EX_TO_DOUBLE(vTemp(1,0));
-	state.z = EX_TO_DOUBLE(vTemp(2,0));
-
-	vTemp = vectorVrepTransform(matrix({{vx},{vy},{vz}}));
-	state.vx = EX_TO_DOUBLE(vTemp(0,0));
-	state.vy = EX_TO_DOUBLE(vTemp(1,0));
-	state.vz = EX_TO_DOUBLE(vTemp(2,0));
-
-	matrix Rpaper = rpy2matrix(matrix({{phi}, {theta}, {psi}}));
-	matrix Rvrep = matrixVrepTransform(Rpaper);
-	matrix abg = matrix2abg(Rvrep);
-	state.a = EX_TO_DOUBLE(abg(0,0));
-	state.b = EX_TO_DOUBLE(abg(1,0));
-	state.g = EX_TO_DOUBLE(abg(2,0));
-
-	matrix vrepOmegaGlob = vectorVrepTransform(omegaGlobalM);
-	state.p = EX_TO_DOUBLE(ex_to<matrix>(vrepOmegaGlob)(0,0));
-	state.q = EX_TO_DOUBLE(ex_to<matrix>(vrepOmegaGlob)(1,0));
-	state.r = EX_TO_DOUBLE(ex_to<matrix>(vrepOmegaGlob)(2,0));
-
+	double in[20] = {
+		EX_TO_DOUBLE(x), EX_TO_DOUBLE(y), EX_TO_DOUBLE(z), EX_TO_DOUBLE(psi),
+		EX_TO_DOUBLE(vx), EX_TO_DOUBLE(vy), EX_TO_DOUBLE(vz)};
+	double out[9] = {
+		EX_TO_DOUBLE(phi), EX_TO_DOUBLE(theta), EX_TO_DOUBLE(omegaGlobalM(0,0)),
+		EX_TO_DOUBLE(omegaGlobalM(1,0)), EX_TO_DOUBLE(omegaGlobalM(2,0))};
+	paper2vrepState(state, in, out);
 }
 
 
@@ -637,13 +1575,13 @@ void flatOutputs2inputs(Inputs &inputs) {
 void genSymbolicEquations(void) {
 
 	// State equations first:
-	ex ba = -cos(symF(Syaw,0,St)) * symF(Sx,2,St) - sin(symF(Syaw,0,St)) * symF(Sy,2,St);
-	ex bb = -symF(Sz,2,St) + GRAVITY_G;
-	ex bc = -sin(symF(Syaw,0,St)) * symF(Sx,2,St) + cos(symF(Syaw,0,St)) * symF(Sy,2,St);
+	ex ba = -cos(symF(FLAT_YAW,0,St)) * symF(FLAT_X,2,St) - sin(symF(FLAT_YAW,0,St)) * symF(FLAT_Y,2,St);
+	ex bb = -symF(FLAT_Z,2,St) + GRAVITY_G;
+	ex bc = -sin(symF(FLAT_YAW,0,St)) * symF(FLAT_X,2,St) + cos(symF(FLAT_YAW,0,St)) * symF(FLAT_Y,2,St);
 
 	equations.phi = atan2(bc, sqrt(ba*ba + bb*bb));
 	equations.theta = atan2(ba, bb);
-	equations.psi = symF(Syaw,0,St);
+	equations.psi = symF(FLAT_YAW,0,St);
 
 	equations.d_phi = equations.phi.diff(St);
 	equations.d_theta = equations.theta.diff(St);
@@ -652,33 +1590,61 @@ void genSymbolicEquations(void) {
 	// Euler rates rpy to angular velocity (remeber: the result is omega in local frame)
 	equations.omega = rpyRate2omega(matrix({{equations.d_phi},{equations.d_theta},{equations.d_psi}}),
 			matrix({{equations.phi},{equations.theta},{equations.psi}}));
+	equations.R = rpy2matrix(matrix({{equations.phi},{equations.theta},{equations.psi}}));
 
-	ex temp_d_omega = equations.omega.diff(St);
-	equations.d_omega = ex_to<matrix>(temp_d_omega.evalm());
+	// The expensive parts, independent: omega and R derivatives, thrust
+	vector<SymbolicTask> tasks;
+	for (unsigned r = 0; r < 3; ++r) {
+		tasks.push_back([r]() {
+			return exvector{equations.omega(r,0).diff(St)};
+		});
+	}
+	for (unsigned r = 0; r < 3; ++r) {
+		tasks.push_back([r]() {
+			exvector row;
+			for (unsigned c = 0; c < 3; ++c) {
+				ex d = equations.R(r,c).diff(St);
+				row.push_back(d);
+				row.push_back(d.diff(St));
+			}
+			return row;
+		});
+	}
+	tasks.push_back([]() {
+		// Inputs: thrust
+			// equations.u_thrust = m_mass * norm(flatOut_D	2[0:2] - GRAVITY_G * [0;0;1])
+		matrix e3 = {{0},{0},{1}};
+		matrix xyzD2 = {{symF(FLAT_X,2,St)},{symF(FLAT_Y,2,St)},{symF(FLAT_Z,2,St)}};
+		ex thrustAccVec = (xyzD2 - GRAVITY_G * e3);			// NOTE: with gravity compensation?
+		matrix thrustAccVecM = ex_to<matrix>(thrustAccVec.evalm());
+		ex thrustAccNorm = thrustAccVecM.transpose() * thrustAccVecM;		// norm of the acceleration vector
+		matrix tempMat = ex_to<matrix>(thrustAccNorm.evalm());
+		return exvector{vehicleParam(0) * sqrt(tempMat(0,0))};		// thrust absolute value
+	});
+	vector<exvector> res = runInitTasks(tasks);
+
+	equations.d_omega = matrix(3, 1);
+	equations.d_R = matrix(3, 3);
+	equations.dd_R = matrix(3, 3);
+	for (unsigned r = 0; r < 3; ++r) {
+		equations.d_omega(r,0) = res[r][0];
+		for (unsigned c = 0; c < 3; ++c) {
+			equations.d_R(r,c) = res[3+r][2*c];
+			equations.dd_R(r,c) = res[3+r][2*c+1];
+		}
+	}
+	equations.u_thrust = res[6][0];
 
 
 	// omega = [0, −r, q; r, 0, −p; −q, p, 0]  (in local frame too)
 	matrix skewOmega = skewMatrix(equations.omega);
 
-	// Inputs: torque
-	ex temp_u_torque = J_inertia * equations.d_omega + skewOmega * J_inertia * equations.omega;
+	// Inputs: torque; mass and inertia stay symbolic, see setVehicleParams()
+	matrix J = symbolicInertia();
+	ex temp_u_torque = J * equations.d_omega + skewOmega * J * equations.omega;
 	equations.u_torque = ex_to<matrix>(temp_u_torque.evalm());
 
-	// Inputs: thrust
-		// equations.u_thrust = m_mass * norm(flatOut_D	2[0:2] - GRAVITY_G * [0;0;1])
-	matrix e3 = {{0},{0},{1}};
-	matrix xyzD2 = {{symF(Sx,2,St)},{symF(Sy,2,St)},{symF(Sz,2,St)}};
-	ex thrustAccVec = (xyzD2 - GRAVITY_G * e3);			// NOTE: with gravity compensation?
-	matrix thrustAccVecM = ex_to<matrix>(thrustAccVec.evalm());
-	ex thrustAccNorm = thrustAccVecM.transpose() * thrustAccVecM;		// norm of the acceleration vector
-	matrix tempMat = ex_to<matrix>(thrustAccNorm.evalm());
-	equations.u_thrust = mass * sqrt(tempMat(0,0));		// thrust absolute value
-
-
-	// Other useful, but unnecessary, equations
-	equations.R = rpy2matrix(matrix({{equations.phi},{equations.theta},{equations.psi}}));
-	equations.d_R = ex_to<matrix>(equations.R.diff(St));
-	equations.dd_R = ex_to<matrix>(equations.d_R.diff(St));
+	symbolicEquationsReady = true;
 	
 
 	// These are equivalent expressions for quantities already computed
@@ -688,7 +1654,7 @@ void genSymbolicEquations(void) {
 	ex d_OmegaEx = d_R.transpose() * d_R + R.transpose() * dd_R;
 	matrix d_Omega = ex_to<matrix>(d_OmegaEx.evalm());
 
-	matrix xyzD2 = {{symF(Sx,2,St)},{symF(Sy,2,St)},{symF(Sz,2,St)}};
+	matrix xyzD2 = {{symF(FLAT_X,2,St)},{symF(FLAT_Y,2,St)},{symF(FLAT_Z,2,St)}};
 	ex thrustVec = equations.R.transpose() * mass * (GRAVITY_G * e3 - xyz_D2);
 	matrix fxVecM = ex_to<matrix>(thrustVec.evalm());
 	equations.u_thrust = fxVecM(2,0);				// NOTE: negative values are set to 0 in flatOutputs2inputs()
@@ -696,26 +1662,167 @@ void genSymbolicEquations(void) {
 }
 
 
+void ensureSymbolicEquations(void) {
+
+	// The symbolic flatness map, for the symbolic mode, codegen and debugging
+	std::lock_guard<std::recursive_mutex> lock(ginacMutex);
+	if (!symbolicEquationsReady) {
+		genSymbolicEquations();
+	}
+}
+
+
+// Memory of D1..D4 and, if generated, of the equations; with compact, equal
+//	subtrees are made one object first, across all of them
+string derivedExpressionsReport(bool compact) {
+
+	matrix *derivs[] = {&flatOut_D1, &flatOut_D2, &flatOut_D3, &flatOut_D4};
+	ex *eqs[] = {&equations.phi, &equations.theta, &equations.psi, &equations.d_phi,
+		&equations.d_theta, &equations.d_psi, &equations.u_thrust};
+	matrix *eqMatrices[] = {&equations.omega, &equations.d_omega, &equations.u_torque,
+		&equations.R, &equations.d_R, &equations.dd_R};
+
+	if (compact) {
+		ExprCompactor compactor;
+		for (matrix *m : derivs) {
+			*m = ex_to<matrix>(compactor.compact(*m));
+		}
+		if (symbolicEquationsReady) {
+			for (ex *e : eqs) {
+				*e = compactor.compact(*e);
+			}
+			for (matrix *m : eqMatrices) {
+				*m = ex_to<matrix>(compactor.compact(*m));
+			}
+		}
+	}
+
+	vector<pair<string, ex>> named;
+	for (unsigned k = 0; k < 4; ++k) {
+		named.push_back({"D" + to_string(k+1), *derivs[k]});
+	}
+	if (symbolicEquationsReady) {
+		const char *eqNames[] = {"phi", "theta", "psi", "d_phi", "d_theta", "d_psi", "u_thrust"};
+		const char *eqMatrixNames[] = {"omega", "d_omega", "u_torque", "R", "d_R", "dd_R"};
+		for (unsigned i = 0; i < 7; ++i) {
+			named.push_back({eqNames[i], *eqs[i]});
+		}
+		for (unsigned i = 0; i < 6; ++i) {
+			named.push_back({eqMatrixNames[i], *eqMatrices[i]});
+		}
+	}
+
+	ostringstream os;
+	vector<ex> all;
+	for (const auto &e : named) {
+		os << e.first << ": " << formatExprStats(profileExpressions({e.second})) << endl;
+		all.push_back(e.second);
+	}
+	os << "all: " << formatExprStats(profileExpressions(all)) << endl;
+	return os.str();
+}
+
+
+// Mean time of a full step (derivatives and flatness map, no memo or
+//	extrapolation) on random poses, in microseconds; -1 if an evaluation
+//	failed. The globals flatOut and flatOut1..4 are restored
+double calibrateStep(void) {
+
+	const unsigned maxSteps = 200;
+	const double maxSeconds = 0.05;
+
+	std::mt19937 random(1);		// the same poses at each run
+	std::uniform_real_distribution<double> position(-2, 2), yaw(-M_PI, M_PI);
+	double s[4];
+	double d[4][4];
+	State state;
+	Inputs inputs;
+	auto step = [&]() {
+		s[0] = position(random);
+		s[1] = position(random);
+		s[2] = position(random);
+		s[3] = yaw(random);
+		for (unsigned i = 0; i < 4; ++i) {
+			flatOut[i] = s[i];
+		}
+		evalFlatOutputs(precisionTier, s, d);
+		evalStateInputs(precisionTier, s, d, state, inputs);
+	};
+
+	ex *globals[] = {flatOut, flatOut1, flatOut2, flatOut3, flatOut4};
+	ex saved[5][4];
+	for (unsigned n = 0; n < 5; ++n) {
+		std::copy(globals[n], globals[n] + 4, saved[n]);
+	}
+
+	// The first step allocates the work buffers: not timed
+	unsigned steps = 0;
+	double elapsed = 0;
+	try {
+		step();
+		auto tStart = chrono::steady_clock::now();
+		while (steps < maxSteps && elapsed < maxSeconds) {
+			step();
+			++steps;
+			elapsed = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+		}
+	} catch (exception &e) {
+		cerr << "FieldFollow: step measurement: " << e.what() << endl;
+		steps = 0;
+	}
+
+	for (unsigned n = 0; n < 5; ++n) {
+		std::copy(saved[n], saved[n] + 4, globals[n]);
+	}
+	return steps ? elapsed * 1e6 / steps : -1;
+}
+
+
+// Measures the step at the current tier and writes the cost report to the
+//	init log. False if the measurement failed: the report is kept
+bool measureCost(void) {
+
+	if (fieldCostReport.empty()) {
+		return false;
+	}
+	double micros = calibrateStep();
+	if (micros < 0) {
+		return false;
+	}
+	fieldStepMicros = micros;
+	DerivBackend derivs = derivBackend(precisionTier);
+	fieldCostReport = formatCostReport(fieldOps, fieldStepMicros,
+			string(backendName(derivs)) + " derivatives, " +
+			backendName(mapBackend(precisionTier)) + " flatness map",
+			derivs == DERIVS_SYMBOLIC);
+	if (diagnostics.on(DIAG_INIT)) {
+		diagnostics.write("Cost:\n" + fieldCostReport);
+	}
+	return true;
+}
+
+
 void setVrepInitialState(string shapeName) {
 
 	// Get the initial pose of the quadcopter shape in the vrep scene
 	quadcopterH = simGetObjectHandle(shapeName.c_str());
-	float initVrepPos[3];
-	float initVrepAbg[3];
-	simGetObjectOrientation(quadcopterH, -1, initVrepAbg);
-	simGetObjectPosition(quadcopterH, -1, initVrepPos);
+	simFloat initVrepPose[12];
+	simGetObjectMatrix(quadcopterH, -1, initVrepPose);
+	double initVrepPos[3];
+	Mat3 initVrepR = vrepPose2mat(initVrepPose, initVrepPos);
 
 	// Compute a configuration in the field
 	Inputs inputs;
 	State state;
-		// NOTE: arg 8 is the 4-th flat output. 6-7 args can be different from state.a,state.b
+		// NOTE: only the yaw of initVrepR is a flat output
 	updateState(inputs, state, initVrepPos[0], initVrepPos[1], initVrepPos[2],
-			initVrepAbg[0], initVrepAbg[1], initVrepAbg[2]);
+			initVrepR);
 	
 
-	// Set the vrep state
-	const float abg[] = {(float)state.a, (float)state.b, (float)state.g};
-	simSetObjectOrientation(quadcopterH, -1, abg);
+	// Set the vrep state: same position, attitude of the field
+	simFloat vrepPose[12];
+	mat2vrepPose(state.R, initVrepPos, vrepPose);
+	simSetObjectMatrix(quadcopterH, -1, vrepPose);
 
 	simSetObjectFloatParameter(quadcopterH, sim_shapefloatparam_init_velocity_x, (float)state.vx);
 	simSetObjectFloatParameter(quadcopterH, sim_shapefloatparam_init_velocity_y, (float)state.vy);
@@ -730,33 +1837,44 @@ void setVrepInitialState(string shapeName) {
 
 	simResetDynamicObject(quadcopterH);
 
-#ifdef DEBUG_PRINT_INIT
-	cout << "Initital pose get:\n";
-	cout << "InitVrepPos: " << initVrepPos[0] << ", " << initVrepPos[1] << ", " << initVrepPos[2] << endl;
-	cout << "InitVrepAbg: " << initVrepAbg[0] << ", " << initVrepAbg[1] << ", " << initVrepAbg[2] << endl;
-	cout << "Inital state set:" << endl;
-	cout << "initPos " << initVrepPos[0] << ", " << initVrepPos[1] << ", " << initVrepPos[2] << endl;
-	cout << "initVel " << state.vx << ", " << state.vy << ", " << state.vz << endl;
-	cout << "init abg " << abg[0] << ", " << abg[1] << ", " << abg[2] << endl;
-	cout << "init angvel " << matrix({{state.p}, {state.q}, {state.r}}) << endl;
-	cout << "Other\n";
-	cout << "abgD1 " << omegaVrep2abgRate(matrix({{state.p}, {state.q}, {state.r}}), matrix({{state.a}, {state.b}, {state.g}})) << endl;
-#endif
+	if (diagnostics.on(DIAG_INIT)) {
+		double initVrepAbg[3];
+		mat2abg(initVrepR, initVrepAbg);
+		const double abg[] = {state.a, state.b, state.g};
+
+		ostringstream os;
+		os << "Initital pose get:\n";
+		os << "InitVrepPos: " << initVrepPos[0] << ", " << initVrepPos[1] << ", " << initVrepPos[2] << endl;
+		os << "InitVrepAbg: " << initVrepAbg[0] << ", " << initVrepAbg[1] << ", " << initVrepAbg[2] << endl;
+		os << "Inital state set:" << endl;
+		os << "initPos " << initVrepPos[0] << ", " << initVrepPos[1] << ", " << initVrepPos[2] << endl;
+		os << "initVel " << state.vx << ", " << state.vy << ", " << state.vz << endl;
+		os << "init abg " << abg[0] << ", " << abg[1] << ", " << abg[2] << endl;
+		os << "init angvel " << matrix({{state.p}, {state.q}, {state.r}}) << endl;
+		os << "Other\n";
+		os << "abgD1 " << omegaVrep2abgRate(matrix({{state.p}, {state.q}, {state.r}}), matrix({{state.a}, {state.b}, {state.g}})) << endl;
+		diagnostics.write(os.str());
+	}
 
-#ifdef DEBUG
-	// Integrating position and rpy
-	// Set integrators' initial states here
-	linVelInt.setInitialState(matrix{{flatOut1[0]},{flatOut1[1]},{flatOut1[2]}});
-	linPosInt.setInitialState(matrix{{flatOut[0]},{flatOut[1]},{flatOut[2]}});
-	RInt.setInitialState(equations.R.evalf());		// R
-	matrix omegaF = ex_to<matrix>(equations.omega.evalf());
-	matrix Omega = {{0, -omegaF(2,0), omegaF(1,0)},
-					{omegaF(2,0), 0, -omegaF(0,0)},
-					{-omegaF(1,0), omegaF(0,0), 0}};
-	d_RInt.setInitialState((equations.R.evalf() * Omega).evalm());	// d_R
-	// DEBUG: checking against integration if starting still
-		cout << "initInt: \n" << linVelInt << endl << d_RInt << endl << linPosInt << endl << RInt << endl << endl;
-#endif
+	if (diagnostics.on(DIAG_INTEGRATION)) {
+		ensureSymbolicEquations();
+
+		// Integrating position and rpy
+		// Set integrators' initial states here
+		linVelInt.setInitialState(matrix{{flatOut1[0]},{flatOut1[1]},{flatOut1[2]}});
+		linPosInt.setInitialState(matrix{{flatOut[0]},{flatOut[1]},{flatOut[2]}});
+		RInt.setInitialState(equations.R.evalf());		// R
+		matrix omegaF = ex_to<matrix>(equations.omega.evalf());
+		matrix Omega = {{0, -omegaF(2,0), omegaF(1,0)},
+						{omegaF(2,0), 0, -omegaF(0,0)},
+						{-omegaF(1,0), omegaF(0,0), 0}};
+		d_RInt.setInitialState((equations.R.evalf() * Omega).evalm());	// d_R
+
+		// checking against integration if starting still
+		ostringstream os;
+		os << "initInt: \n" << linVelInt << endl << d_RInt << endl << linPosInt << endl << RInt << endl << endl;
+		diagnostics.write(os.str());
+	}
 }
 
 
@@ -774,7 +1892,14 @@ int initField(string fieldFilePath, string shapeName, bool vrepCaller) {
 		return false;
 	}
 
+	// The dependencies of the previous field are not valid any more
+	{
+		std::lock_guard<std::recursive_mutex> lock(ginacMutex);
+		componentDeps.clear();
+	}
+
 	// Prepare the GiNaC parser
+	asyncInit.setStage(INIT_PARSE);
 	symtab table;
 	vector <symbol> vars = {Sx, Sy, Sz, Syaw};
 	table["x"] = Sx;
@@ -783,39 +1908,457 @@ int initField(string fieldFilePath, string shapeName, bool vrepCaller) {
 	table["w"] = Syaw;
 	parser reader(table);
 
-	// Get the first lines in the file as a vector
-	nVars = 0;
-	while (getline(vectFile, line)) {
-		vectFieldStr.push_back(line);
-		++nVars;
-	}
-	vectFile.close();
-	//vars.erase(vars.begin()+nVars, vars.end());
-		// NOTE: if this is commented, differentiation is on all 4 vars (usually nothing changes)
+	// Get the first lines in the file as a vector
+	nVars = 0;
+	string fieldText;
+	while (getline(vectFile, line)) {
+		vectFieldStr.push_back(line);
+		fieldText += line + "\n";
+		++nVars;
+	}
+	vectFile.close();
+		// NOTE: the components after nVars are zero, and their variables are
+		//	skipped by the Lie derivative
+
+	// Fill a symbolic matrix
+	matrix vectFieldSym(4, 1);
+	for (unsigned i = 0; i < nVars; ++i) {
+		ex e = reader(vectFieldStr[i]);
+		vectFieldSym.set(i, 0, e);
+	}
+	
+	// Save the first flat output derivative d(sigma)/dt=V(x)
+	flatOut_D1 = vectFieldSym;
+
+	// Compute next derivatives
+	auto tDerivatives = chrono::steady_clock::now();
+	genDerivatives(vars);
+	{
+		std::lock_guard<std::recursive_mutex> lock(ginacMutex);
+		componentDeps.analyze({&flatOut_D1, &flatOut_D2, &flatOut_D3, &flatOut_D4}, vars);
+	}
+	double derivativesTime = chrono::duration<double>(chrono::steady_clock::now() -
+			tDerivatives).count();
+
+	// Compiled kernel for this field
+	asyncInit.setStage(INIT_COMPILE);
+	kernelActive = kernelMatches(fieldText);
+	fieldAtlas.clear();
+	evalMemo.clear();
+	multiRate.clear();
+
+	// Polynomial fields: D1..D4 as coefficient tables
+	polyDerivs.set(vars, {&flatOut_D1, &flatOut_D2, &flatOut_D3, &flatOut_D4});
+
+	// Numeric D1 for bulk sampling, if all the functions are supported
+	fieldTape.compile({flatOut_D1(0,0), flatOut_D1(1,0), flatOut_D1(2,0),
+			flatOut_D1(3,0)});
+	++fieldVersion;
+
+	// Sums of localized terms (Gaussian obstacles): only the near ones
+	gaussField.clear();
+	if (!polyDerivs.isEnabled()) {
+		gaussField.set({flatOut_D1(0,0), flatOut_D1(1,0), flatOut_D1(2,0),
+				flatOut_D1(3,0)}, vars);
+	}
+
+	if (diagnostics.on(DIAG_INIT)) {
+		ostringstream os;
+		os << "Polynomial field: " << (polyDerivs.isEnabled() ? "yes" : "no") <<
+			", linear: " << (polyDerivs.isLinear() ? "yes" : "no") <<
+			", compiled kernel: " << (kernelActive ? "yes" : "no") <<
+			", local terms: " << gaussField.numLocalTerms() << endl;
+		os << "Derivatives: " << derivativesTime << " s, workers: " << initWorkers <<
+				", cached partials: " << lieDerivative.cacheSize() << ", hits: " <<
+				lieDerivative.cacheHits() << endl;
+		os << "Dependencies: " << componentDeps.summary() << endl;
+		diagnostics.write(os.str());
+	}
+	lieDerivative.clear();
+
+	initVehicle(shapeName, vrepCaller);
+	reportTierFallback();
+
+	// Operations of D1..D4; the step is measured by measureCost(), in V-REP
+	const matrix *orders[] = {&flatOut_D1, &flatOut_D2, &flatOut_D3, &flatOut_D4};
+	for (unsigned k = 0; k < 4; ++k) {
+		for (unsigned i = 0; i < 4; ++i) {
+			fieldOps[k][i] = countOps((*orders[k])(i,0));
+		}
+	}
+	fieldStepMicros = 0;
+	fieldCostReport = formatCostReport(fieldOps, 0, "", false);
+	return true;
+}
+
+
+// New mass and inertia, without generating the equations again: they read
+//	the parameters at evaluation. False if not positive
+bool setVehicleParams(double newMass, const double J[9]) {
+
+	if (newMass <= 0 || J[0] <= 0 || J[4] <= 0 || J[8] <= 0) {
+		return false;
+	}
+	mass = newMass;
+	for (unsigned i = 0; i < 9; ++i) {
+		J_inertia(i/3, i%3) = J[i];
+		J_numeric[i] = J[i];
+	}
+	kernelMapActive = kernelActive && kernelVehicleMatches();
+	evalMemo.clear();
+	return true;
+}
+
+
+// Common to initField() and initAtlas(), after the field is loaded
+void initVehicle(string shapeName, bool vrepCaller) {
+
+	// Numeric vehicle parameters
+	for (unsigned i = 0; i < 9; ++i) {
+		J_numeric[i] = EX_TO_DOUBLE(J_inertia(i/3, i%3));
+	}
+	kernelMapActive = kernelActive && kernelVehicleMatches();
+
+	// Save equations to globals (not needed by the numeric flatness map)
+	symbolicEquationsReady = false;
+	if (!numericFlatnessMap) {
+		asyncInit.setStage(INIT_EQUATIONS);
+		genSymbolicEquations();
+	}
+
+	// Assigns initial config in vrep scene to match the vector field
+	if (vrepCaller) {
+		setVrepInitialState(shapeName);
+	}
+}
+
+
+int initAtlas(string atlasFilePath, string shapeName, bool vrepCaller) {
+
+	// All the fields are compiled here; the flat output derivatives are
+	//	computed numerically, so the symbolic D1..D4 are not used
+	vector <symbol> vars = {Sx, Sy, Sz, Syaw};
+	if (!fieldAtlas.load(atlasFilePath, vars)) {
+		return false;
+	}
+	nVars = 4;
+	++fieldVersion;
+	kernelActive = false;
+	polyDerivs.clear();
+	gaussField.clear();
+	evalMemo.clear();
+	multiRate.clear();
+	{
+		std::lock_guard<std::recursive_mutex> lock(ginacMutex);
+		componentDeps.clear();
+	}
+	fieldCostReport.clear();
+	fieldStepMicros = 0;
+
+	if (diagnostics.on(DIAG_INIT)) {
+		ostringstream os;
+		os << "Field atlas: " << fieldAtlas.size() << " fields" << endl;
+		diagnostics.write(os.str());
+	}
+
+	initVehicle(shapeName, vrepCaller);
+	reportTierFallback();
+	return true;
+}
+
+
+int genFieldKernel(string fieldFilePath, ostream &os) {
+
+	// Writes the field derivatives and the flatness map as expression
+	//	templates. Leaves: x,y,z,w and symF(index, n, t) as In<4*n + index>
+
+	if (!initField(fieldFilePath, "", false)) {
+		return false;
+	}
+	ensureSymbolicEquations();
+
+	const vector<symbol> vars = {Sx, Sy, Sz, Syaw};
+	auto varIndex = [&vars](const ex &e) {
+		for (unsigned i = 0; i < vars.size(); ++i) {
+			if (e.is_equal(vars[i])) return (int)i;
+		}
+		return -1;
+	};
+	auto leaf = [&varIndex](const ex &e) {
+		if (is_a<symbol>(e)) {
+			return varIndex(e);
+		}
+		if (is_a<GiNaC::function>(e) && ex_to<GiNaC::function>(e).get_name() == "symF") {
+			int index = ex_to<numeric>(e.op(0)).to_int();
+			int n = ex_to<numeric>(e.op(1)).to_int();
+			return 4*n + index;
+		}
+		return -1;
+	};
+
+	try {
+		KernelCodeGen gen(leaf);
+
+		vector<ex> derivs;
+		for (const matrix *D : {&flatOut_D1, &flatOut_D2, &flatOut_D3, &flatOut_D4}) {
+			for (unsigned i = 0; i < 4; ++i) {
+				derivs.push_back((*D)(i,0));
+			}
+		}
+		gen.addList("Derivatives", derivs);
+
+		matrix omegaGlobal = ex_to<matrix>((equations.R * equations.omega).evalm());
+		gen.addList("FlatnessMap", {equations.phi, equations.theta,
+				omegaGlobal(0,0), omegaGlobal(1,0), omegaGlobal(2,0),
+				bakeVehicleParams(equations.u_torque(0,0)),
+				bakeVehicleParams(equations.u_torque(1,0)),
+				bakeVehicleParams(equations.u_torque(2,0)),
+				bakeVehicleParams(equations.u_thrust)});
+
+		// Constants to check at initialization
+		ostringstream J;
+		J << setprecision(17);
+		for (unsigned i = 0; i < 9; ++i) {
+			J << (i ? ", " : "") << EX_TO_DOUBLE(J_inertia(i/3, i%3));
+		}
+		string fileName = fieldFilePath.substr(fieldFilePath.find_last_of("/\\") + 1);
+		ostringstream massStr;
+		massStr << setprecision(17) << mass;
+		ifstream fieldFile(fieldFilePath);
+		string line, fieldText;
+		while (getline(fieldFile, line)) {
+			fieldText += line + "\n";
+		}
+
+		gen.write(os, "FieldKernel", {
+				"static constexpr const char *fieldName = \"" + fileName + "\";",
+				"static constexpr uint64_t fieldHash = " +
+					std::to_string(fieldContentHash(fieldText)) + "ULL;",
+				"static constexpr double mass = " + massStr.str() + ";",
+				"static inline double J(unsigned r, unsigned c) {",
+				"\tstatic const double v[9] = {" + J.str() + "};",
+				"\treturn v[r*3 + c];",
+				"}"});
+
+	} catch (std::runtime_error &e) {
+		cerr << e.what() << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+// Compares every numeric backend to the reference updateState (exact tier:
+//	subs and evalf, symbolic flatness map) on random poses; returns the number
+//	of failed checks
+int crossCheck(const vector<string> &fieldFiles, unsigned samples, ostream &os) {
+
+	// Flattened outputs of a State: positions, velocities, angular velocity
+	//	and attitude matrix (angles can wrap)
+	auto stateValues = [](const State &st, double v[18]) {
+		const double head[] = {st.x, st.y, st.z, st.vx, st.vy, st.vz, st.p, st.q, st.r};
+		std::copy(head, head+9, v);
+		for (unsigned i = 0; i < 9; ++i) {
+			v[9+i] = st.R(i/3, i%3);
+		}
+	};
+	auto inputValues = [](const Inputs &in, double v[4]) {
+		v[0] = in.fz; v[1] = in.tx; v[2] = in.ty; v[3] = in.tz;
+	};
+
+	std::mt19937 random(1);		// the same poses at each run
+	std::uniform_real_distribution<double> position(-2, 2), yaw(-M_PI, M_PI),
+		tilt(-0.5, 0.5);
+
+	PrecisionTier tier = precisionTier;
+	int failed = 0;
+	for (const string &file : fieldFiles) {
+
+		if (!initField(file, "", false)) {
+			os << file << ": can't load\n";
+			++failed;
+			continue;
+		}
+		ensureSymbolicEquations();
+
+		// Backends of the field derivatives, if available for this field
+		typedef std::function<void(const double s[4], double d[4][4])> Derivs;
+		vector<pair<string, Derivs>> derivBackends;
+		if (kernelActive) {
+			derivBackends.push_back({"kernel", [](const double s[4], double d[4][4]) {
+				kernelDerivatives(s, d);
+			}});
+		}
+		if (polyDerivs.isEnabled()) {
+			derivBackends.push_back({"poly", [](const double s[4], double d[4][4]) {
+				polyDerivs.eval(s, d);
+			}});
+		}
+		if (gaussField.isEnabled()) {
+			derivBackends.push_back({"gauss", [](const double s[4], double d[4][4]) {
+				gaussField.eval(s, d);
+			}});
+		}
+		if (fieldTape.numOutputs() == 4) {
+			derivBackends.push_back({"tape", [](const double s[4], double d[4][4]) {
+				tFlowDerivatives(s, d, [](const Taylor S[4], Taylor V[4], unsigned order) {
+					thread_local vector<Taylor> work;
+					fieldTape.evalTaylor(S, V, order, work);
+				});
+			}});
+		}
+
+		// Error distributions; the float tier has its own tolerance
+		vector<ErrorStats> stats;
+		for (const auto &b : derivBackends) {
+			for (unsigned k = 0; k < 4; ++k) {
+				stats.push_back(ErrorStats(b.first + " D" + to_string(k+1), 1e-6));
+			}
+		}
+		const unsigned mapStats = stats.size();
+		stats.push_back(ErrorStats("numeric map state", 1e-6));
+		stats.push_back(ErrorStats("numeric map inputs", 1e-6));
+		if (kernelMapActive) {
+			stats.push_back(ErrorStats("kernel map state", 1e-6));
+			stats.push_back(ErrorStats("kernel map inputs", 1e-6));
+		}
+		const unsigned tierStats = stats.size();
+		stats.push_back(ErrorStats("double tier state", 1e-6));
+		stats.push_back(ErrorStats("double tier inputs", 1e-6));
+		stats.push_back(ErrorStats("float tier state", 1e-3));
+		stats.push_back(ErrorStats("float tier inputs", 1e-3));
+
+		unsigned skipped = 0;
+		for (unsigned n = 0; n < samples; ++n) {
+
+			// A vrep pose, and its flat outputs
+			double xyz[3] = {position(random), position(random), position(random)};
+			Mat3 Rvrep = abg2mat(tilt(random), tilt(random), yaw(random));
+			double s[4];
+			vrepPose2flatOutputs(xyz[0], xyz[1], xyz[2], Rvrep, s);
+			double dRef[4][4], d[4][4];
+			State stRef, st;
+			Inputs inRef, in;
+			double refV[18], v[18];
+
+			// Reference: the plugin's updateState in the exact tier
+			try {
+				precisionTier = TIER_EXACT;
+				evalMemo.clear();
+				updateState(inRef, stRef, xyz[0], xyz[1], xyz[2], Rvrep);
+				precisionTier = tier;
+			} catch (std::exception &e) {
+				precisionTier = tier;
+				++skipped;		// e.g. a singularity of the field
+				continue;
+			}
+			const ex *refOuts[] = {flatOut1, flatOut2, flatOut3, flatOut4};
+			for (unsigned k = 0; k < 4; ++k) {
+				for (unsigned i = 0; i < 4; ++i) {
+					dRef[k][i] = EX_TO_DOUBLE(refOuts[k][i]);
+				}
+			}
+
+			unsigned j = 0;
+			for (const auto &b : derivBackends) {
+				b.second(s, d);
+				for (unsigned k = 0; k < 4; ++k) {
+					stats[j++].add(d[k], dRef[k], 4, s);
+				}
+			}
+
+			// Flatness maps on the reference derivatives
+			j = mapStats;
+			numericFlatOutputs(st, in, s, dRef);
+			stateValues(st, v); stateValues(stRef, refV);
+			stats[j++].add(v, refV, 18, s);
+			inputValues(in, v); inputValues(inRef, refV);
+			stats[j++].add(v, refV, 4, s);
+			if (kernelMapActive) {
+				kernelFlatOutputs(st, in, s, dRef);
+				stateValues(st, v); stateValues(stRef, refV);
+				stats[j++].add(v, refV, 18, s);
+				inputValues(in, v); inputValues(inRef, refV);
+				stats[j++].add(v, refV, 4, s);
+			}
+
+			// Whole runtime evaluation at each tier
+			j = tierStats;
+			for (PrecisionTier tier : {TIER_DOUBLE, TIER_FLOAT}) {
+				evalFlatOutputs(tier, s, d);
+				evalStateInputs(tier, s, d, st, in);
+				stateValues(st, v); stateValues(stRef, refV);
+				stats[j++].add(v, refV, 18, s);
+				inputValues(in, v); inputValues(inRef, refV);
+				stats[j++].add(v, refV, 4, s);
+			}
+		}
 
-	// Fill a symbolic matrix
-	matrix vectFieldSym(4, 1);
-	for (unsigned i = 0; i < nVars; ++i) {
-		ex e = reader(vectFieldStr[i]);
-		vectFieldSym.set(i, 0, e);
+		os << file << ": " << samples << " poses, " << skipped << " skipped\n";
+		for (const ErrorStats &e : stats) {
+			os << "  ";
+			e.report(os);
+			failed += e.passed() ? 0 : 1;
+		}
+		if (skipped == samples) {
+			os << "  no pose evaluated  FAILED\n";
+			++failed;
+		}
 	}
-	
-	// Save the first flat output derivative d(sigma)/dt=V(x)
-	flatOut_D1 = vectFieldSym;
+	evalMemo.clear();
 
-	// Compute next derivatives
-	genNextDerivative(vars, flatOut_D1, flatOut_D1, flatOut_D2);
-	genNextDerivative(vars, flatOut_D2, flatOut_D1, flatOut_D3);
-	genNextDerivative(vars, flatOut_D3, flatOut_D1, flatOut_D4);
+	return failed;
+}
 
-	// Save equations to globals
-	genSymbolicEquations();
 
-	// Assigns initial config in vrep scene to match the vector field
-	if (vrepCaller) {
-		setVrepInitialState(shapeName);
+// Evaluates the poses of a file (see poseBatch.hpp) with the loaded field.
+//	Numeric backends run in parallel, the symbolic evaluation sequentially
+bool evalPoseBatch(string poseFile) {
+
+	auto record = [](const Inputs &inputs, const State &state, double out[16]) {
+		const double v[16] = {inputs.fz, inputs.tx, inputs.ty, inputs.tz,
+			state.x, state.y, state.z, state.vx, state.vy, state.vz,
+			state.a, state.b, state.g, state.p, state.q, state.r};
+		std::copy(v, v+16, out);
+	};
+
+	// The field sampling runs in parallel; the symbolic flatness map, in its
+	//	own context in each thread, holds ginacMutex for each pose
+	DerivBackend derivs = derivBackend(precisionTier);
+	bool parallel = (derivs != DERIVS_FLOAT_TAPE && derivs != DERIVS_SYMBOLIC);
+	PoseEval eval;
+	if (parallel) {
+		if (mapBackend(TIER_DOUBLE) == MAP_SYMBOLIC) {
+			ensureSymbolicEquations();		// may fork: before the threads
+		}
+		eval = [&record](const double pose[6], double out[16]) {
+			double s[4], d[4][4];
+			vrepPose2flatOutputs(pose[0], pose[1], pose[2], abg2mat(pose[3], pose[4], pose[5]), s);
+			sampleDerivatives(s, d, 4);
+
+			Inputs inputs;
+			State state;
+			evalStateInputs(TIER_DOUBLE, s, d, state, inputs);
+			record(inputs, state, out);
+		};
+	} else {
+		eval = [&record](const double pose[6], double out[16]) {
+			Inputs inputs;
+			State state;
+			updateState(inputs, state, pose[0], pose[1], pose[2], pose[3], pose[4], pose[5]);
+			record(inputs, state, out);
+		};
 	}
 
+	auto tStart = chrono::steady_clock::now();
+	long long n = runPoseBatch(poseFile, eval, parallel, cerr);
+	if (n < 0) {
+		return false;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+	cerr << n << " poses in " << seconds << " s (" << (parallel ? "parallel" : "sequential") <<
+		")\n";
 	return true;
 }
 
@@ -826,6 +2369,8 @@ void debugging(Inputs& inputs, State& state) {
 	if (! RInt.isInitialized()) {
 		return;
 	}
+	std::lock_guard<std::recursive_mutex> lock(ginacMutex);
+	ensureSymbolicEquations();
 
 	// Inputs
 	ex u_thrust = (equations.u_thrust.evalf());
@@ -860,27 +2405,27 @@ void debugging(Inputs& inputs, State& state) {
 	matrix vrepLinPos = vectorVrepTransform(linPosInt.getMat());
 	matrix vrepAbgPos = matrix2abg(matrixVrepTransform(R));
 
-#ifdef DEBUG_SET_INTEGRATION
-	// Vrep convention
-	float vrepLinPosF[3];
-	vrepLinPosF[0] = EX_TO_DOUBLE(vrepLinPos(0,0));
-	vrepLinPosF[1] = EX_TO_DOUBLE(vrepLinPos(1,0));
-	vrepLinPosF[2] = EX_TO_DOUBLE(vrepLinPos(2,0));
-	
-	float vrepAbgPosF[3];
-	vrepAbgPosF[0] = EX_TO_DOUBLE(vrepAbgPos(0,0));
-	vrepAbgPosF[1] = EX_TO_DOUBLE(vrepAbgPos(1,0));
-	vrepAbgPosF[2] = EX_TO_DOUBLE(vrepAbgPos(2,0));
-	
-	simSetObjectPosition(quadcopterH, -1, vrepLinPosF);
-	simSetObjectOrientation(quadcopterH, -1, vrepAbgPosF);
-	
-	// debug: off motors
-	inputs.fz = 0;
-	inputs.tx = 0;
-	inputs.ty = 0;
-	inputs.tz = 0;
-#endif // DEBUG_SET_INTEGRATION
+	if (diagnostics.on(DIAG_SET_INTEGRATION)) {
+		// Vrep convention
+		float vrepLinPosF[3];
+		vrepLinPosF[0] = EX_TO_DOUBLE(vrepLinPos(0,0));
+		vrepLinPosF[1] = EX_TO_DOUBLE(vrepLinPos(1,0));
+		vrepLinPosF[2] = EX_TO_DOUBLE(vrepLinPos(2,0));
+		
+		float vrepAbgPosF[3];
+		vrepAbgPosF[0] = EX_TO_DOUBLE(vrepAbgPos(0,0));
+		vrepAbgPosF[1] = EX_TO_DOUBLE(vrepAbgPos(1,0));
+		vrepAbgPosF[2] = EX_TO_DOUBLE(vrepAbgPos(2,0));
+		
+		simSetObjectPosition(quadcopterH, -1, vrepLinPosF);
+		simSetObjectOrientation(quadcopterH, -1, vrepAbgPosF);
+		
+		// debug: off motors
+		inputs.fz = 0;
+		inputs.tx = 0;
+		inputs.ty = 0;
+		inputs.tz = 0;
+	}
 
 	// >> End integration
 	
@@ -908,84 +2453,493 @@ void debugging(Inputs& inputs, State& state) {
 	simFloat vrepLinVelSim[3], vrepAngVelSim[3];
 	simGetObjectVelocity(quadcopterH, vrepLinVelSim, vrepAngVelSim);
 
-	cout << "----------------\n";
-	cout << "vrep " << endl;
-	cout << "equations    angvel: " << vrepOmega << endl;
+	ostringstream os;
+	os << "----------------\n";
+	os << "vrep " << endl;
+	os << "equations    angvel: " << vrepOmega << endl;
 		// These are all valid measures and correspond to equations angvel under integration
-	cout << "measure my   angvel: " << vrepAngVel << endl;
-	cout << "measure vrep angvel: " << GINAC_3VEC(vrepAngVelSim) << endl;
-	cout << "measure pos: " << matrix({{state.x}, {state.y}, {state.z}}) << endl;
-	cout << "paper " << endl;
-	cout << "u_torque    : " << u_torque << endl;
-	cout << "u_torqueGlob: " << (equations.R.evalf() * u_torque).evalm() << endl;
-	cout << "omegaGlobInt: " << omegaGlobInt << endl;
-	cout << endl;
+	os << "measure my   angvel: " << vrepAngVel << endl;
+	os << "measure vrep angvel: " << GINAC_3VEC(vrepAngVelSim) << endl;
+	os << "measure pos: " << matrix({{state.x}, {state.y}, {state.z}}) << endl;
+	os << "paper " << endl;
+	os << "u_torque    : " << u_torque << endl;
+	os << "u_torqueGlob: " << (equations.R.evalf() * u_torque).evalm() << endl;
+	os << "omegaGlobInt: " << omegaGlobInt << endl;
+	os << endl;
+	diagnostics.write(os.str());
+
+}
+
+
+// The tier that evaluates a request: float needs the expression tape of a
+//	single field, exact the symbolic derivatives of one; else double
+PrecisionTier availableTier(PrecisionTier tier) {
+
+	if (tier == TIER_FLOAT && (fieldTape.numOutputs() != 4 || fieldAtlas.isEnabled())) {
+		return TIER_DOUBLE;
+	}
+	if (tier == TIER_EXACT && fieldAtlas.isEnabled()) {
+		return TIER_DOUBLE;
+	}
+	return tier;
+}
+
+
+// Warns if the loaded field can't evaluate precisionTier; false if so
+bool reportTierFallback(void) {
+
+	PrecisionTier tier = availableTier(precisionTier);
+	if (tier == precisionTier) {
+		return true;
+	}
+	cerr << "FieldFollow: the " << (precisionTier == TIER_FLOAT ? "float" : "exact") <<
+		" tier is not available for the loaded field, evaluating in double" << endl;
+	return false;
+}
+
+
+// Backend of the field derivatives at a tier, the one evalFlatOutputs() uses
+DerivBackend derivBackend(PrecisionTier tier) {
+
+	tier = availableTier(tier);
+	if (tier == TIER_FLOAT) {
+		return DERIVS_FLOAT_TAPE;
+	}
+	if (tier != TIER_EXACT && canSampleField()) {
+		return sampledBackend();
+	}
+	return DERIVS_SYMBOLIC;
+}
+
+
+// Backend of the flatness map at a tier, the one evalStateInputs() uses
+MapBackend mapBackend(PrecisionTier tier) {
+
+	if (availableTier(tier) == TIER_EXACT) {
+		return MAP_EXACT;
+	}
+	return kernelMapActive ? MAP_KERNEL : numericFlatnessMap ? MAP_NUMERIC : MAP_SYMBOLIC;
+}
+
+
+// Flat output derivatives at s, in d and in the globals flatOut1..4
+void evalFlatOutputs(PrecisionTier tier, const double s[4], double d[4][4]) {
+
+	DerivBackend backend = derivBackend(tier);
+	if (backend == DERIVS_FLOAT_TAPE) {
+
+		tFlowDerivatives<float>(s, d, [](const TaylorF S[4], TaylorF V[4], unsigned order) {
+			thread_local vector<TaylorF> work;
+			fieldTape.evalTaylor(S, V, order, work);
+		});
+
+	} else if (backend != DERIVS_SYMBOLIC) {
+
+		// Atlas, compiled kernel, polynomial, localized terms or tape: no
+		//	symbolic substitutions
+		sampleDerivatives(s, d, 4);
+
+	} else {
+
+		// The cached components are shared by all the threads
+		std::lock_guard<std::recursive_mutex> lock(ginacMutex);
+		exmap symMap;
+		symMap[Sx] = s[0];
+		symMap[Sy] = s[1];
+		symMap[Sz] = s[2];
+		symMap[Syaw] = s[3];
+
+		// fill the globals flatOutputs derivatives; a component is substituted
+		//	only if its flat outputs changed
+		const matrix *orders[] = {&flatOut_D1, &flatOut_D2, &flatOut_D3, &flatOut_D4};
+		ex *globals[] = {flatOut1, flatOut2, flatOut3, flatOut4};
+		for (unsigned k = 0; k < 4; ++k) {
+			for (unsigned i = 0; i < 4; ++i) {
+				globals[k][i] = componentDeps.get(k, i, s, [&]() {
+					return (*orders[k])(i,0).subs(symMap).evalf();
+				});
+			}
+		}
+
+		for (unsigned i = 0; i < 4; ++i) {
+			d[0][i] = EX_TO_DOUBLE(flatOut1[i]);
+			d[1][i] = EX_TO_DOUBLE(flatOut2[i]);
+			d[2][i] = EX_TO_DOUBLE(flatOut3[i]);
+			d[3][i] = EX_TO_DOUBLE(flatOut4[i]);
+		}
+		return;
+	}
+
+	for (unsigned i = 0; i < 4; ++i) {
+		flatOut1[i] = d[0][i];
+		flatOut2[i] = d[1][i];
+		flatOut3[i] = d[2][i];
+		flatOut4[i] = d[3][i];
+	}
+}
+
+
+// Symbolic flatness map at s, d, in a context of its own: can be called from
+//	several threads, but GiNaC evaluates one pose at a time
+void symbolicStateInputs(const double s[4], const double d[4][4], State &state,
+		Inputs &inputs) {
+
+	std::lock_guard<std::recursive_mutex> lock(ginacMutex);
+	ex values[5][4];
+	for (unsigned i = 0; i < 4; ++i) {
+		values[0][i] = s[i];
+		for (unsigned k = 0; k < 4; ++k) {
+			values[k+1][i] = d[k][i];
+		}
+	}
+	FlatContext ctx = {{values[0], values[1], values[2], values[3], values[4]}};
+	FlatContextScope scope(ctx);
+
+	ensureSymbolicEquations();
+	flatOutputs2state(state);
+	flatOutputs2inputs(inputs);
+}
+
+
+// State and inputs from the flat outputs; the exact tier uses the symbolic
+//	equations, that read flatOut and flatOut1..4
+void evalStateInputs(PrecisionTier tier, const double s[4], const double d[4][4],
+		State &state, Inputs &inputs) {
+
+	MapBackend backend = mapBackend(tier);
+	if (backend == MAP_EXACT) {
+		std::lock_guard<std::recursive_mutex> lock(ginacMutex);
+		ensureSymbolicEquations();
+		flatOutputs2state(state);
+		flatOutputs2inputs(inputs);
+	} else if (backend == MAP_KERNEL) {
+		kernelFlatOutputs(state, inputs, s, d);
+	} else if (backend == MAP_NUMERIC) {
+		numericFlatOutputs(state, inputs, s, d);
+	} else {
+		symbolicStateInputs(s, d, state, inputs);
+	}
+}
+
+
+// Evaluates s again at the next tier and tracks the error of the inputs.
+//	An atlas has no exact tier: its reference is the double sampler with the
+//	symbolic flatness map. The globals flatOut1..4 are restored to d
+void shadowEvaluation(const double s[4], const double d[4][4], const Inputs &inputs) {
+
+	PrecisionTier ref = (availableTier(precisionTier) == TIER_FLOAT) ? TIER_DOUBLE : TIER_EXACT;
+	double dRef[4][4];
+	State stateRef;
+	Inputs inputsRef;
+	if (ref == TIER_EXACT && fieldAtlas.isEnabled()) {
+		evalFlatOutputs(TIER_DOUBLE, s, dRef);
+		symbolicStateInputs(s, dRef, stateRef, inputsRef);
+	} else {
+		evalFlatOutputs(ref, s, dRef);
+		evalStateInputs(ref, s, dRef, stateRef, inputsRef);
+	}
+
+	for (unsigned i = 0; i < 4; ++i) {
+		flatOut1[i] = d[0][i];
+		flatOut2[i] = d[1][i];
+		flatOut3[i] = d[2][i];
+		flatOut4[i] = d[3][i];
+	}
+
+	const double values[] = {inputs.fz, inputs.tx, inputs.ty, inputs.tz};
+	const double reference[] = {inputsRef.fz, inputsRef.tx, inputsRef.ty, inputsRef.tz};
+	if (shadowStats.add(values, reference, 4, nIter) && diagnostics.on(DIAG_INPUTS)) {
+		ostringstream os;
+		os << "Shadow: max relative error on inputs " << shadowStats.maxRelError <<
+			" at step " << nIter << endl;
+		diagnostics.write(os.str());
+	}
+}
+
+
+// Flat output derivatives in doubles, thread-safe; false if there is
+//	only the symbolic evaluation for this field
+bool canSampleField(void) {
+	return fieldAtlas.isEnabled() || kernelActive || polyDerivs.isEnabled() ||
+		gaussField.isEnabled() || fieldTape.numOutputs() == 4;
+}
+
+
+// The backend of sampleDerivatives(); requires canSampleField()
+DerivBackend sampledBackend(void) {
+
+	if (fieldAtlas.isEnabled()) {
+		return DERIVS_ATLAS;
+	} else if (kernelActive) {
+		return DERIVS_KERNEL;
+	} else if (polyDerivs.isEnabled()) {
+		return DERIVS_POLY;
+	} else if (gaussField.isEnabled()) {
+		return DERIVS_GAUSS;
+	}
+	return DERIVS_TAPE;
+}
+
+
+// d[k] for k < orders, paper convention; requires canSampleField()
+void sampleDerivatives(const double s[4], double d[4][4], unsigned orders) {
+
+	DerivBackend backend = sampledBackend();
+	if (backend == DERIVS_ATLAS) {
+		fieldAtlas.eval(s, d);
+	} else if (backend == DERIVS_KERNEL) {
+		kernelDerivatives(s, d);
+	} else if (backend == DERIVS_POLY) {
+		polyDerivs.eval(s, d);
+	} else if (backend == DERIVS_GAUSS) {
+		gaussField.eval(s, d);
+	} else if (orders == 1) {
+		fieldTape.eval(s, d[0]);
+	} else {
+		tFlowDerivatives(s, d, [](const Taylor S[4], Taylor V[4], unsigned order) {
+			thread_local vector<Taylor> work;
+			fieldTape.evalTaylor(S, V, order, work);
+		});
+	}
+}
+
+
+// Same, with flat outputs and derivatives in vrep convention (y, z, yaw flipped)
+void sampleDerivativesVrep(const double s[4], double d[4][4], unsigned orders) {
+
+	const double flip[4] = {1, -1, -1, -1};
+	double sPaper[4];
+	for (unsigned i = 0; i < 4; ++i) {
+		sPaper[i] = flip[i] * s[i];
+	}
+	sampleDerivatives(sPaper, d, orders);
+	for (unsigned k = 0; k < orders; ++k) {
+		for (unsigned i = 0; i < 4; ++i) {
+			d[k][i] *= flip[i];
+		}
+	}
+}
+
+
+void removeFieldDrawing(void) {
+
+	if (fieldDrawingH >= 0) {
+		simRemoveDrawingObject(fieldDrawingH);
+		fieldDrawingH = -1;
+	}
+}
+
+
+// Arrows (D1 * scale) and streamlines; redrawn only if something changed
+int drawField(const SampleGrid &grid, double scale, unsigned steps, double dt) {
+
+	if (fieldDrawingH >= 0 && grid == drawnGrid && scale == drawnScale &&
+			steps == drawnSteps && dt == drawnDt && fieldVersion == drawnVersion) {
+		return fieldDrawingH;
+	}
+	removeFieldDrawing();
+	if (grid.size() == 0 || !canSampleField()) {
+		return -1;
+	}
+
+	vector<double> d, lines;
+	sampleField(grid, 1, sampleDerivativesVrep, d);
+	if (steps > 0) {
+		traceStreamlines(grid, steps, dt, sampleDerivativesVrep, lines);
+	}
+
+	const float arrowColor[] = {0.1, 0.4, 1.0};
+	fieldDrawingH = simAddDrawingObject(sim_drawing_lines | sim_drawing_vertexcolors, 1,
+			0, -1, grid.size() * (steps + 1), arrowColor, NULL, NULL, NULL);
+	if (fieldDrawingH < 0) {
+		return -1;
+	}
+
+	// Segments with vertex colors: arrows from blue to white, streamlines green
+	double s[4];
+	float item[12];
+	for (unsigned p = 0; p < grid.size(); ++p) {
+		grid.point(p, s);
+		const double *v = &d[p*4];
+		if (!std::isfinite(v[0]) || !std::isfinite(v[1]) || !std::isfinite(v[2])) {
+			continue;
+		}
+		const float arrow[] = {
+			(float)s[0], (float)s[1], (float)s[2],
+			(float)(s[0] + scale*v[0]), (float)(s[1] + scale*v[1]), (float)(s[2] + scale*v[2]),
+			0.1, 0.4, 1.0, 1.0, 1.0, 1.0};
+		simAddDrawingObjectItem(fieldDrawingH, arrow);
+
+		for (unsigned j = 0; j < steps; ++j) {
+			const double *a = &lines[(p*(steps+1) + j)*3];
+			for (unsigned i = 0; i < 6; ++i) {
+				item[i] = a[i];
+			}
+			const float green[] = {0.2, 0.8, 0.2, 0.2, 0.8, 0.2};
+			std::copy(green, green+6, item+6);
+			if (std::isfinite(item[3]) && std::isfinite(item[4]) && std::isfinite(item[5])) {
+				simAddDrawingObjectItem(fieldDrawingH, item);
+			}
+		}
+	}
+
+	drawnGrid = grid;
+	drawnScale = scale;
+	drawnSteps = steps;
+	drawnDt = dt;
+	drawnVersion = fieldVersion;
+	return fieldDrawingH;
+}
+
+
+void recordTelemetry(const double xyz[3], const Mat3 &Rvrep, const double s[4],
+		const double d[4][4], const State &state, const Inputs &inputs,
+		chrono::steady_clock::time_point tStart) {
+
+	TelemetryRecord *rec = telemetry.beginRecord();
+	if (!rec) {
+		return;
+	}
+
+	auto now = chrono::steady_clock::now();
+	rec->step = nIter;
+	rec->time = chrono::duration<double>(now - telemetryStart).count();
+	rec->evalTime = chrono::duration<double>(now - tStart).count();
+
+	std::copy(xyz, xyz+3, rec->pose);
+	mat2abg(Rvrep, rec->pose+3);
+	std::copy(s, s+4, rec->flat[0]);
+	std::copy(&d[0][0], &d[0][0]+16, rec->flat[1]);
+
+	static_assert(offsetof(State, R) == sizeof(rec->state), "State layout");
+	memcpy(rec->state, &state, sizeof(rec->state));
+
+	rec->inputs[0] = inputs.fz;
+	rec->inputs[1] = inputs.tx;
+	rec->inputs[2] = inputs.ty;
+	rec->inputs[3] = inputs.tz;
 
+	telemetry.commitRecord();
 }
 
 
-// The registered vrep function for evaluating the inputs
+// Flat outputs in paper convention (z downwards) of a vrep pose
+void vrepPose2flatOutputs(double x, double y, double z, const Mat3 &Rvrep, double s[4]) {
+
+	s[0] = x;
+	s[1] = -y;
+	s[2] = -z;
+
+	// Only the yaw is a flat output: atan2(Rpaper(1,0), Rpaper(0,0))
+	s[3] = atan2(-Rvrep(1,0), Rvrep(0,0));
+}
+
+
+// The registered vrep function for evaluating the inputs; vrep angles
 void updateState(Inputs &inputs, State &state, double x, double y, double z,
 		double a, double b, double g) {
 
-	// Pass from the v-rep axis convention to reference paper conv. (z downwards)
-	matrix vTemp = vectorVrepTransform(matrix({{x}, {y}, {z}}));
-	x = EX_TO_DOUBLE(vTemp(0,0));
-	y = EX_TO_DOUBLE(vTemp(1,0));
-	z = EX_TO_DOUBLE(vTemp(2,0));
+	updateState(inputs, state, x, y, z, abg2mat(a, b, g));
+}
+
+
+// Same, with the vrep attitude as a rotation matrix
+void updateState(Inputs &inputs, State &state, double x, double y, double z,
+		const Mat3 &Rvrep) {
 
-	matrix Rvrep = abg2matrix(matrix({{a}, {b}, {g}}));
-	matrix Rpaper = matrixVrepTransform(Rvrep);
-	matrix rpy = matrix2rpy(Rpaper);
-	double yaw = EX_TO_DOUBLE(rpy(2,0));
+	auto tStart = chrono::steady_clock::now();
+	const double xyz[3] = {x, y, z};
 
 	// Evaluate the D4 vectors numerically
-	exmap symMap;
-	symMap[Sx] = x;
-	symMap[Sy] = y;
-	symMap[Sz] = z;
-	symMap[Syaw] = yaw;
+	double s[4];
+	vrepPose2flatOutputs(x, y, z, Rvrep, s);
+	double d[4][4];
+
+	// Multi-rate: between field evaluations, s and d are the reference of the
+	//	last one, extrapolated to the simulation time
+	PrecisionTier tier = availableTier(precisionTier);
+	double t = multiRate.isEnabled() ? simGetSimulationTime() : 0;
+	bool extrapolated = tier != TIER_EXACT && multiRate.extrapolate(t, s, d);
+
+	// Already evaluated at these flat outputs, e.g. update and updateFeedback
+	//	in one step: copy. An extrapolated reference only if d is the same
+	const EvalMemo<State, Inputs>::Entry *memoEntry = evalMemo.find(s);
+	if (memoEntry && extrapolated &&
+			!std::equal(&d[0][0], &d[0][0]+16, &memoEntry->d[0][0])) {
+		memoEntry = NULL;
+	}
+	if (memoEntry) {
+
+		std::copy(&memoEntry->d[0][0], &memoEntry->d[0][0]+16, &d[0][0]);
+		for (unsigned i = 0; i < 4; ++i) {
+			flatOut1[i] = d[0][i];
+			flatOut2[i] = d[1][i];
+			flatOut3[i] = d[2][i];
+			flatOut4[i] = d[3][i];
+		}
+		state = memoEntry->state;
+		inputs = memoEntry->inputs;
 
-	// fill the globals flatOutputs derivatives
-	for (unsigned i = 0; i < 4; ++i) {
-		flatOut1[i] = flatOut_D1(i,0).subs(symMap).evalf();
-		flatOut2[i] = flatOut_D2(i,0).subs(symMap).evalf();
-		flatOut3[i] = flatOut_D3(i,0).subs(symMap).evalf();
-		flatOut4[i] = flatOut_D4(i,0).subs(symMap).evalf();
+	} else if (extrapolated) {
+
+		for (unsigned i = 0; i < 4; ++i) {
+			flatOut1[i] = d[0][i];
+			flatOut2[i] = d[1][i];
+			flatOut3[i] = d[2][i];
+			flatOut4[i] = d[3][i];
+		}
+
+	} else {
+		evalFlatOutputs(precisionTier, s, d);
+	}
+	if (!extrapolated && multiRate.isEnabled()) {
+		multiRate.anchor(t, s, d);
 	}
 
 	// save to global
-	flatOut[0] = x;
-	flatOut[1] = y;
-	flatOut[2] = z;
-	flatOut[3] = yaw;
+	for (unsigned i = 0; i < 4; ++i) {
+		flatOut[i] = s[i];
+	}
 
-	// Get the state of the quadrotor
-	flatOutputs2state(state);
-	flatOutputs2inputs(inputs);
+	// Get the state of the quadrotor; only the flatness map if extrapolated
+	if (!memoEntry) {
+		evalStateInputs(precisionTier, s, d, state, inputs);
+		evalMemo.store(s, d, state, inputs);
 
-#ifdef DEBUG_PRINT_FLAT_OUTPUTS
-	// Deb_print
-	cout << "flatOut: " << flatOut[0] << ", " << flatOut[1] << ", " <<
-		flatOut[2] << ", " << flatOut[3] << endl;
-	cout << "flatOut1: " << flatOut1[0] << ", " << flatOut1[1] << ", " <<
-		flatOut1[2] << ", " << flatOut1[3] << endl;
-	cout << "flatOut2: " << flatOut2[0] << ", " << flatOut2[1] << ", " <<
-		flatOut2[2] << ", " << flatOut2[3] << endl;
-	cout << "flatOut3: " << flatOut3[0] << ", " << flatOut3[1] << ", " <<
-		flatOut3[2] << ", " << flatOut3[3] << endl;
-	cout << "flatOut4: " << flatOut4[0] << ", " << flatOut4[1] << ", " <<
-		flatOut4[2] << ", " << flatOut4[3] << endl << endl;
-#endif
+		if (!extrapolated && tier != TIER_EXACT && shadowStats.due()) {
+			shadowEvaluation(s, d, inputs);
+		}
+	}
 
-#ifdef DEBUG
-	debugging(inputs, state);
-#endif
+	if (diagnostics.on(DIAG_FLAT_OUTPUTS)) {
+		ostringstream os;
+		os << "flatOut: " << flatOut[0] << ", " << flatOut[1] << ", " <<
+			flatOut[2] << ", " << flatOut[3] << endl;
+		os << "flatOut1: " << flatOut1[0] << ", " << flatOut1[1] << ", " <<
+			flatOut1[2] << ", " << flatOut1[3] << endl;
+		os << "flatOut2: " << flatOut2[0] << ", " << flatOut2[1] << ", " <<
+			flatOut2[2] << ", " << flatOut2[3] << endl;
+		os << "flatOut3: " << flatOut3[0] << ", " << flatOut3[1] << ", " <<
+			flatOut3[2] << ", " << flatOut3[3] << endl;
+		os << "flatOut4: " << flatOut4[0] << ", " << flatOut4[1] << ", " <<
+			flatOut4[2] << ", " << flatOut4[3] << endl << endl;
+		diagnostics.write(os.str());
+	}
 
-#ifdef DEBUG_PRINT_INPUTS
-	cout << "Inputs [fz, tx, ty, tz]: [" << inputs.fz << ", " << inputs.tx <<
-		", " << inputs.ty << ", " << inputs.tz << "]\n\n";
-#endif
+	if (diagnostics.on(DIAG_INTEGRATION)) {
+		debugging(inputs, state);
+	}
+
+	if (diagnostics.on(DIAG_INPUTS)) {
+		ostringstream os;
+		os << "Inputs [fz, tx, ty, tz]: [" << inputs.fz << ", " << inputs.tx <<
+			", " << inputs.ty << ", " << inputs.tz << "]\n\n";
+		diagnostics.write(os.str());
+	}
+
+	if (telemetry.isRunning()) {
+		recordTelemetry(xyz, Rvrep, s, d, state, inputs, tStart);
+	}
 	
 	++nIter;
 }
@@ -1012,42 +2966,96 @@ void simpleFeedback(Inputs &inputs, State &estState, const matrix &xyz,
 		const matrix &abg, const matrix &v, const matrix &omega,
 		const matrix &gains) {
 
-	matrix e3{{0},{0},{1}};
-	cout << "gains " << gains << endl;
+	double xyzD[3], vD[3], omegaD[3], gainsD[4];
+	for (unsigned i = 0; i < 3; ++i) {
+		xyzD[i] = EX_TO_DOUBLE(xyz(i,0));
+		vD[i] = EX_TO_DOUBLE(v(i,0));
+		omegaD[i] = EX_TO_DOUBLE(omega(i,0));
+	}
+	for (unsigned i = 0; i < 4; ++i) {
+		gainsD[i] = EX_TO_DOUBLE(gains(i,0));
+	}
+	Mat3 R = abg2mat(EX_TO_DOUBLE(abg(0,0)), EX_TO_DOUBLE(abg(1,0)),
+			EX_TO_DOUBLE(abg(2,0)));
+
+	simpleFeedback(inputs, estState, xyzD, R, vD, omegaD, gainsD);
+}
+
+
+// Same controller in doubles; R: current attitude, vrep rotation matrix
+void simpleFeedback(Inputs &inputs, const State &estState, const double xyz[3],
+		const Mat3 &R, const double v[3], const double omega[3],
+		const double gains[4]) {
+
+	if (diagnostics.on(DIAG_INPUTS)) {
+		ostringstream os;
+		os << "gains [" << gains[0] << ", " << gains[1] << ", " << gains[2] <<
+			", " << gains[3] << "]" << endl;
+		diagnostics.write(os.str());
+	}
 
 	// Defining position and velocity errors
-	matrix xyzDes{{estState.x},{estState.y},{estState.z}};
-	matrix vDes{{estState.vx},{estState.vy},{estState.vz}};
-	ex xyzErr = xyz - xyzDes;
-	ex vErr = v - vDes;
+	double xyzErr[3] = {xyz[0] - estState.x, xyz[1] - estState.y, xyz[2] - estState.z};
+	double vErr[3] = {v[0] - estState.vx, v[1] - estState.vy, v[2] - estState.vz};
 
 	// Defining attitude and angular velocity errors
-	matrix abgDes{{estState.a},{estState.b},{estState.g}};
-	matrix omegaDes{{estState.p},{estState.q},{estState.r}};
-	matrix RDes(abg2matrix(abgDes));
-	matrix R(abg2matrix(abg));
-
-	matrix RS(ex_to<matrix>((RDes.transpose()*R - R.transpose()*RDes).evalm()));
-	ex RErr = matrix{{RS(2,1)},{-RS(2,0)},{RS(1,0)}}; // 1/2 scale removed
-	ex omegaErr = omega - R.transpose() * RDes * omegaDes;
-
-	// Gains
-	ex Kp = gains(0,0) * diag_matrix({1,1,1});
-	ex Kv = gains(1,0) * diag_matrix({1,1,1}); 
-	ex Kr = gains(2,0) * diag_matrix({1,1,1}); 
-	ex Ko = gains(3,0) * diag_matrix({1,1,1}); 
-	
+	const Mat3 &RDes = estState.R;
+	Mat3 RtRDes = transpose(R) * RDes;
+	Mat3 RDestR = transpose(RDes) * R;
+
+	double RErr[3] = {	// 1/2 scale removed
+		RDestR(2,1) - RtRDes(2,1),
+		-(RDestR(2,0) - RtRDes(2,0)),
+		RDestR(1,0) - RtRDes(1,0)};
+
+	const double omegaDes[3] = {estState.p, estState.q, estState.r};
+	double omegaDesBody[3];
+	mulVec(RtRDes, omegaDes, omegaDesBody);
+
 	// Control
-	ex thrust = (R.mul(e3)).transpose() * (Kp * xyzErr + Kv * vErr);
-	ex torque = - Kr * RErr - Ko * omegaErr;
+	double thrust = 0;
+	for (unsigned i = 0; i < 3; ++i) {
+		thrust += R(i,2) * (gains[0] * xyzErr[i] + gains[1] * vErr[i]);
+	}
+
+	double torque[3];
+	for (unsigned i = 0; i < 3; ++i) {
+		torque[i] = - gains[2] * RErr[i] - gains[3] * (omega[i] - omegaDesBody[i]);
+	}
 
-	matrix thrustM(ex_to<matrix>(thrust.evalm()));
-	matrix torqueM(ex_to<matrix>(torque.evalm()));
+	inputs.fz += (thrust > 0)? thrust: 0;
+	inputs.tx += torque[0];
+	inputs.ty += torque[1];
+	inputs.tz += torque[2];
+}
+
+
+// Geometric controller on SE(3), with the feed-forward 'inputs' of
+//	updateState(); replaces them. Same arguments of simpleFeedback()
+void geometricFeedback(Inputs &inputs, const State &desState, const double xyz[3],
+		const Mat3 &R, const double v[3], const double omega[3]) {
+
+	SE3Target target = {{desState.x, desState.y, desState.z},
+		{desState.vx, desState.vy, desState.vz}, desState.R,
+		{desState.p, desState.q, desState.r}, inputs.fz,
+		{inputs.tx, inputs.ty, inputs.tz}};
+	SE3State now = {{xyz[0], xyz[1], xyz[2]}, {v[0], v[1], v[2]}, R,
+		{omega[0], omega[1], omega[2]}};
 
-	inputs.fz += (thrustM(0,0)>0)? EX_TO_FLOAT(thrustM(0,0)): 0;
-	inputs.tx += EX_TO_FLOAT(torqueM(0,0));
-	inputs.ty += EX_TO_FLOAT(torqueM(1,0));
-	inputs.tz += EX_TO_FLOAT(torqueM(2,0));
+	// The inertia in vrep body axes: F J F, F = diag(1, -1, -1)
+	const double flip[3] = {1, -1, -1};
+	double J[9];
+	for (unsigned i = 0; i < 9; ++i) {
+		J[i] = flip[i/3] * flip[i%3] * J_numeric[i];
+	}
+
+	double thrust, torque[3];
+	geometricControl(geometricGains, J, target, now, thrust, torque);
+
+	inputs.fz = (thrust > 0) ? thrust : 0;
+	inputs.tx = torque[0];
+	inputs.ty = torque[1];
+	inputs.tz = torque[2];
 }
 
 
@@ -1107,6 +3115,18 @@ VREP_DLLEXPORT unsigned char v_repStart(void* reservedPointer,int reservedInt)
 			strConCat("number ok = ",LUA_INIT_COMMAND,"(string filePath, string shapeName, number mass, table9 inertiaMatrix)"),
 			LUA_INIT_CALLBACK);
 
+	simRegisterScriptCallbackFunction(strConCat(LUA_INITASYNC_COMMAND,"@","FieldFollow"),
+			strConCat("number ticket = ",LUA_INITASYNC_COMMAND,"(string filePath, string shapeName, number mass, table9 inertiaMatrix)"),
+			LUA_INITASYNC_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_INITSTATUS_COMMAND,"@","FieldFollow"),
+			strConCat("string stage, number progress, boolean ready, boolean ok = ",LUA_INITSTATUS_COMMAND,"(number ticket)"),
+			LUA_INITSTATUS_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_INITATLAS_COMMAND,"@","FieldFollow"),
+			strConCat("number ok = ",LUA_INITATLAS_COMMAND,"(string atlasPath, string shapeName, number mass, table9 inertiaMatrix)"),
+			LUA_INITATLAS_CALLBACK);
+
 	simRegisterScriptCallbackFunction(strConCat(LUA_UPDATE_COMMAND,"@","FieldFollow"),
 			strConCat("",LUA_UPDATE_COMMAND,"(table3 xyx, table3 abg)"),
 			LUA_UPDATE_CALLBACK);
@@ -1115,6 +3135,77 @@ VREP_DLLEXPORT unsigned char v_repStart(void* reservedPointer,int reservedInt)
 			strConCat("",LUA_UPDATEFEEDBACK_COMMAND,"(table3 xyz, table3 abg, table3 v, table3 omegaBodyFrame, table4 gains)"),
 			LUA_UPDATEFEEDBACK_CALLBACK);
 
+	simRegisterScriptCallbackFunction(strConCat(LUA_UPDATEQUATERNION_COMMAND,"@","FieldFollow"),
+			strConCat("number fz, number tx, number ty, number tz, table4 quaternionDes = ",LUA_UPDATEQUATERNION_COMMAND,"(table3 xyz, table4 quaternion)"),
+			LUA_UPDATEQUATERNION_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_UPDATEMATRIX_COMMAND,"@","FieldFollow"),
+			strConCat("number fz, number tx, number ty, number tz, table12 matrixDes = ",LUA_UPDATEMATRIX_COMMAND,"(table12 matrix)"),
+			LUA_UPDATEMATRIX_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_UPDATEFEEDBACKQUATERNION_COMMAND,"@","FieldFollow"),
+			strConCat("",LUA_UPDATEFEEDBACKQUATERNION_COMMAND,"(table3 xyz, table4 quaternion, table3 v, table3 omegaBodyFrame, table4 gains)"),
+			LUA_UPDATEFEEDBACKQUATERNION_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_TELEMETRY_COMMAND,"@","FieldFollow"),
+			strConCat("number ok = ",LUA_TELEMETRY_COMMAND,"(string logFilePath)"),
+			LUA_TELEMETRY_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_DIAGNOSTICS_COMMAND,"@","FieldFollow"),
+			strConCat("number ok = ",LUA_DIAGNOSTICS_COMMAND,"(string channels)"),
+			LUA_DIAGNOSTICS_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_SETFLATNESSMAP_COMMAND,"@","FieldFollow"),
+			strConCat("number ok = ",LUA_SETFLATNESSMAP_COMMAND,"(string mode)"),
+			LUA_SETFLATNESSMAP_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_SAMPLEFIELD_COMMAND,"@","FieldFollow"),
+			strConCat("table derivatives, table streamlines = ",LUA_SAMPLEFIELD_COMMAND,"(table3 lo, table3 hi, table3 counts, number orders, number yaw, number streamlineSteps, number dt)"),
+			LUA_SAMPLEFIELD_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_DRAWFIELD_COMMAND,"@","FieldFollow"),
+			strConCat("number drawingHandle = ",LUA_DRAWFIELD_COMMAND,"(table3 lo, table3 hi, table3 counts, number arrowScale, number streamlineSteps, number dt)"),
+			LUA_DRAWFIELD_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_SETINITWORKERS_COMMAND,"@","FieldFollow"),
+			strConCat("",LUA_SETINITWORKERS_COMMAND,"(number workers)"),
+			LUA_SETINITWORKERS_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_SETPRECISION_COMMAND,"@","FieldFollow"),
+			strConCat("number ok = ",LUA_SETPRECISION_COMMAND,"(string tier, number shadowFraction)"),
+			LUA_SETPRECISION_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_GETSHADOWSTATS_COMMAND,"@","FieldFollow"),
+			strConCat("number samples, number maxRelError, number worstStep = ",LUA_GETSHADOWSTATS_COMMAND,"()"),
+			LUA_GETSHADOWSTATS_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_SETVEHICLEPARAMS_COMMAND,"@","FieldFollow"),
+			strConCat("number ok = ",LUA_SETVEHICLEPARAMS_COMMAND,"(number mass, table9 inertiaMatrix)"),
+			LUA_SETVEHICLEPARAMS_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_SETFEEDBACK_COMMAND,"@","FieldFollow"),
+			strConCat("number ok = ",LUA_SETFEEDBACK_COMMAND,"(string mode, table gains)"),
+			LUA_SETFEEDBACK_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_SETMULTIRATE_COMMAND,"@","FieldFollow"),
+			strConCat("number ok = ",LUA_SETMULTIRATE_COMMAND,"(number ratio, number tolerance)"),
+			LUA_SETMULTIRATE_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_GETMULTIRATESTATS_COMMAND,"@","FieldFollow"),
+			strConCat("number evaluations, number extrapolated, number forced = ",LUA_GETMULTIRATESTATS_COMMAND,"()"),
+			LUA_GETMULTIRATESTATS_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_EXPRPROFILE_COMMAND,"@","FieldFollow"),
+			strConCat("string report = ",LUA_EXPRPROFILE_COMMAND,"(boolean compact)"),
+			LUA_EXPRPROFILE_CALLBACK);
+	simRegisterScriptCallbackFunction(strConCat(LUA_GETCOSTREPORT_COMMAND,"@","FieldFollow"),
+			strConCat("string report, number stepMicros = ",LUA_GETCOSTREPORT_COMMAND,"(boolean recalibrate)"),
+			LUA_GETCOSTREPORT_CALLBACK);
+
+	simRegisterScriptCallbackFunction(strConCat(LUA_SETMEMO_COMMAND,"@","FieldFollow"),
+			strConCat("number ok = ",LUA_SETMEMO_COMMAND,"(number entries)"),
+			LUA_SETMEMO_CALLBACK);
+
 	return(PLUGIN_VERSION); // initialization went fine, we return the version number of this plugin (can be queried with simGetModuleName)
 }
 
@@ -1122,6 +3213,9 @@ VREP_DLLEXPORT unsigned char v_repStart(void* reservedPointer,int reservedInt)
 VREP_DLLEXPORT void v_repEnd()
 {
 	// Here you could handle various clean-up tasks
+	telemetry.stop();
+	asyncInit.wait();
+	diagnostics.stop();
 
 	unloadVrepLibrary(vrepLib); // release the library
 }
@@ -1182,6 +3276,12 @@ VREP_DLLEXPORT void* v_repMessage(int message,int* auxiliaryData,void* customDat
 
 	if (message==sim_message_eventcallback_simulationended)
 	{ // Simulation just ended
+		telemetry.stop();
+		if (!asyncInit.isRunning()) {
+			evalMemo.clear();
+			multiRate.clear();
+		}
+		removeFieldDrawing();
 
 	}
 
@@ -1238,14 +3338,71 @@ VREP_DLLEXPORT void* v_repMessage(int message,int* auxiliaryData,void* customDat
 }
 
 
-int main() {
-	
+int main(int argc, char *argv[]) {
+
+	// Kernel generation: --codegen fieldFile mass J00 J01 ... J22
+	if (argc > 1 && string(argv[1]) == "--codegen") {
+		if (argc != 13) {
+			cerr << "Usage: " << argv[0] << " --codegen fieldFile mass J(9 values)\n";
+			return 1;
+		}
+		mass = atof(argv[3]);
+		for (unsigned i = 0; i < 9; ++i) {
+			J_inertia(i/3, i%3) = atof(argv[4+i]);
+		}
+		return genFieldKernel(argv[2], cout) ? 0 : 1;
+	}
+
+	// Batch evaluation: --batch fieldFile mass J00 J01 ... J22 [poseFile]
+	if (argc > 1 && string(argv[1]) == "--batch") {
+		if (argc != 13 && argc != 14) {
+			cerr << "Usage: " << argv[0] << " --batch fieldFile mass J(9 values) " <<
+				"[poses.csv | poses.bin | -]\n";
+			return 1;
+		}
+		mass = atof(argv[3]);
+		for (unsigned i = 0; i < 9; ++i) {
+			J_inertia(i/3, i%3) = atof(argv[4+i]);
+		}
+		if (!initField(argv[2], "", false)) {
+			return 1;
+		}
+		return evalPoseBatch(argc == 14 ? argv[13] : "-") ? 0 : 1;
+	}
+
 	// Set the same Vrep dynamic properties
 	mass = 0.87;
 	J_inertia.set(0,0, 0.006);
 	J_inertia.set(1,1, 0.006);
 	J_inertia.set(2,2, 0.011);
 
+	// Differential check: --crosscheck samples fieldFile...
+	if (argc > 1 && string(argv[1]) == "--crosscheck") {
+		if (argc < 4) {
+			cerr << "Usage: " << argv[0] << " --crosscheck samples fieldFile...\n";
+			return 1;
+		}
+		numericFlatnessMap = true;
+		return crossCheck(vector<string>(argv + 3, argv + argc), atoi(argv[2]), cout) ? 1 : 0;
+	}
+
+	// Expression memory: --exprprofile fieldFile [compact]
+	if (argc > 1 && string(argv[1]) == "--exprprofile") {
+		if (argc != 3 && !(argc == 4 && string(argv[3]) == "compact")) {
+			cerr << "Usage: " << argv[0] << " --exprprofile fieldFile [compact]\n";
+			return 1;
+		}
+		if (!initField(argv[2], "", false)) {
+			return 1;
+		}
+		ensureSymbolicEquations();
+		cout << derivedExpressionsReport(false);
+		if (argc == 4) {
+			cout << "\nCompacted:\n" << derivedExpressionsReport(true);
+		}
+		return 0;
+	}
+
 	initField("./circle-field.txt", "", false);
 
 	// set a fictitious pose
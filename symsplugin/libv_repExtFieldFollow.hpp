@@ -10,11 +10,43 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstddef>
+#include <iomanip>
+#include <chrono>
 #include <cmath>
+#include <random>
+#include <thread>
 #include <cln/cln.h>
 #include <ginac/ginac.h>
 #include "v_repLib.h"
 #include "tinyIntegrator.hpp"
+#include "attitude.hpp"
+#include "polyField.hpp"
+#include "fieldAtlas.hpp"
+#include "gaussField.hpp"
+#include "fieldSampler.hpp"
+#include "flatnessMap.hpp"
+#include "fieldCodegen.hpp"
+#include "telemetry.hpp"
+#include "diagnostics.hpp"
+#include "evalMemo.hpp"
+#include "precision.hpp"
+#include "crossCheck.hpp"
+#include "poseBatch.hpp"
+#include "symbolicWorkers.hpp"
+#include "asyncInit.hpp"
+#include "lieDerivative.hpp"
+#include "componentDeps.hpp"
+#include "geometricControl.hpp"
+#include "multiRate.hpp"
+#include "flatContext.hpp"
+#include "exprProfile.hpp"
+#include "costReport.hpp"
+#ifdef FIELD_KERNEL
+	#include "fieldKernelGen.hpp"		// make kernel
+#endif
 #include "luaFunctionData.h"
 #include "scriptFunctionData.h"
 #include "stack/stackArray.h"
@@ -46,8 +78,10 @@ using GiNaC::matrix;
 
 // State vector; saved in vrep conventions (angles and frames)
 //		p,q,r is the angular velocity in global vrep frame
+//		R is the same attitude of a,b,g as a rotation matrix
 struct State {
 	double x, y, z, vx, vy, vz, a, b, g, p, q, r;
+	Mat3 R;
 };
 
 // input vector: thrust + torques in v_vrep axis convention
@@ -59,11 +93,55 @@ struct Inputs {
 // custom commands
 int initField(std::string fieldFilePath, std::string shapeName, bool vrepCaller);
 		// read vector field file equations
+int initAtlas(std::string atlasFilePath, std::string shapeName, bool vrepCaller);
+		// read and compile a set of fields with regions
+void initVehicle(std::string shapeName, bool vrepCaller);
+		// vehicle parameters and initial state, after the field is loaded
+void setVrepInitialState(std::string shapeName);
+		// scene pose of the shape at the field's initial state
+bool setVehicleParams(double newMass, const double J[9]);
+		// mass and inertia between steps, the equations are kept
 void updateState(Inputs &inputs, double x, double y, double z, double yaw);
 		// Eval symbolic equations
+void vrepPose2flatOutputs(double x, double y, double z, const Mat3 &Rvrep, double s[4]);
+		// flat outputs of a vrep pose, paper convention
 void simpleFeedback(Inputs &inputs, State &estState, const matrix &xyz,
 		const matrix &abg, const matrix &v, const matrix &omega,
 		const matrix &gains);
+void simpleFeedback(Inputs &inputs, const State &estState, const double xyz[3],
+		const Mat3 &R, const double v[3], const double omega[3],
+		const double gains[4]);
+void geometricFeedback(Inputs &inputs, const State &desState, const double xyz[3],
+		const Mat3 &R, const double v[3], const double omega[3]);
+int genFieldKernel(std::string fieldFilePath, std::ostream &os);
+		// write the expression templates of a field
+int crossCheck(const std::vector<std::string> &fieldFiles, unsigned samples,
+		std::ostream &os);
+		// numeric backends against the reference updateState
+bool evalPoseBatch(std::string poseFile);
+		// poses of a file, with the loaded field
+PrecisionTier availableTier(PrecisionTier tier);
+bool reportTierFallback(void);
+void evalFlatOutputs(PrecisionTier tier, const double s[4], double d[4][4]);
+void evalStateInputs(PrecisionTier tier, const double s[4], const double d[4][4],
+		State &state, Inputs &inputs);
+std::string derivedExpressionsReport(bool compact);
+DerivBackend derivBackend(PrecisionTier tier);
+MapBackend mapBackend(PrecisionTier tier);
+double calibrateStep(void);
+bool measureCost(void);
+void symbolicStateInputs(const double s[4], const double d[4][4], State &state,
+		Inputs &inputs);
+void shadowEvaluation(const double s[4], const double d[4][4], const Inputs &inputs);
+		// runtime evaluation at a precision tier
+bool canSampleField(void);
+DerivBackend sampledBackend(void);
+void sampleDerivatives(const double s[4], double d[4][4], unsigned orders);
+void sampleDerivativesVrep(const double s[4], double d[4][4], unsigned orders);
+		// thread-safe numeric derivatives, paper or vrep convention
+int drawField(const SampleGrid &grid, double scale, unsigned steps, double dt);
+void removeFieldDrawing(void);
+		// arrows and streamlines as a drawing object
 
 
 // The 3 required entry points of the V-REP plugin:
@@ -0,0 +1,87 @@
+
+#include "lieDerivative.hpp"
+
+using namespace GiNaC;
+using std::vector;
+
+
+void LieDerivative::set(const vector<symbol> &newVars, const vector<ex> &newField) {
+
+	clear();
+	vars = newVars;
+	field = newField;
+	field.resize(vars.size(), 0);
+	partials.resize(vars.size());
+
+	for (const ex &v : field) {
+		for (unsigned i = 0; i < vars.size(); ++i) {
+			partial(v, i);
+		}
+	}
+}
+
+
+ex LieDerivative::partial(const ex &f, unsigned var) {
+
+	const symbol &x = vars[var];
+	if (!f.has(x)) {
+		return 0;
+	}
+	if (is_a<symbol>(f)) {
+		return 1;
+	}
+
+	auto &cache = partials[var];
+	auto found = cache.find(f);
+	if (found != cache.end()) {
+		++hits;
+		return found->second;
+	}
+
+	ex d = 0;
+	if (is_a<add>(f)) {
+		for (size_t i = 0; i < f.nops(); ++i) {
+			d += partial(f.op(i), var);
+		}
+	} else if (is_a<mul>(f)) {
+		// Product rule, over the factors that depend on x
+		for (size_t i = 0; i < f.nops(); ++i) {
+			ex di = partial(f.op(i), var);
+			if (di.is_zero()) {
+				continue;
+			}
+			ex term = di;
+			for (size_t j = 0; j < f.nops(); ++j) {
+				if (j != i) {
+					term *= f.op(j);
+				}
+			}
+			d += term;
+		}
+	} else if (is_a<power>(f) && !f.op(1).has(x)) {
+		const ex &base = f.op(0), &expo = f.op(1);
+		d = expo * pow(base, expo - 1) * partial(base, var);
+	} else {
+		// Functions and variable exponents
+		d = f.diff(x);
+	}
+
+	cache.emplace(f, d);
+	return d;
+}
+
+
+ex LieDerivative::next(const ex &f) {
+
+	ex dest = 0;
+	for (unsigned i = 0; i < vars.size(); ++i) {
+		if (field[i].is_zero() || !f.has(vars[i])) {
+			continue;
+		}
+		ex d = partial(f, i);
+		if (!d.is_zero()) {
+			dest += d * field[i];
+		}
+	}
+	return dest;
+}
@@ -0,0 +1,61 @@
+// Lie derivative along the field V: L_V f = sum_i df/dx_i * V_i, term by
+// term, skipping the variables f or V don't depend on. The partials of the
+// subexpressions are cached: those of V, and of each order for the next one
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <ginac/ginac.h>
+
+
+class LieDerivative {
+
+	private:
+		std::vector<GiNaC::symbol> vars;
+		std::vector<GiNaC::ex> field;		// V_i, component of vars[i]
+
+		// Per variable: subexpression -> partial derivative
+		std::vector<std::map<GiNaC::ex, GiNaC::ex, GiNaC::ex_is_less>> partials;
+		unsigned long long hits = 0;
+		size_t workerPartials = 0;		// cached by worker processes
+
+	public:
+
+		// Clears the cache, then caches the partials of V (the Jacobian
+		//	entries), that every order needs
+		void set(const std::vector<GiNaC::symbol> &newVars,
+				const std::vector<GiNaC::ex> &newField);
+
+		// df/dx_var
+		GiNaC::ex partial(const GiNaC::ex &f, unsigned var);
+
+		// L_V f
+		GiNaC::ex next(const GiNaC::ex &f);
+
+		void clear(void) {
+			vars.clear();
+			field.clear();
+			partials.clear();
+			hits = 0;
+			workerPartials = 0;
+		}
+
+		// Counts of a worker that started from this cache
+		void addWorkerStats(size_t newPartials, unsigned long long newHits) {
+			workerPartials += newPartials;
+			hits += newHits;
+		}
+
+		size_t cacheSize(void) const {
+			size_t n = workerPartials;
+			for (const auto &p : partials) {
+				n += p.size();
+			}
+			return n;
+		}
+
+		unsigned long long cacheHits(void) const {
+			return hits;
+		}
+};
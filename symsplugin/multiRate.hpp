@@ -0,0 +1,124 @@
+// Multi-rate evaluation: the field is evaluated at one step out of 'ratio'
+// (an anchor); in between, the reference flat outputs and their derivatives
+// are Taylor-extrapolated from the anchor to the simulation time, and only
+// the flatness map runs. Calls at the same time are one step. A drift from
+// the measured flat outputs over the tolerance re-anchors
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+
+class MultiRate {
+
+	private:
+		unsigned ratio = 1;			// steps per field evaluation, 1 disables
+		double tolerance = 0;		// max drift of x, y, z, yaw
+
+		bool anchored = false;
+		double t0;					// time of the anchor
+		double s0[4];
+		double d0[4][4];
+		unsigned steps = 0;			// since the anchor
+		double last;				// time of the last step
+
+		unsigned long long anchors = 0;
+		unsigned long long extrapolated = 0;
+		unsigned long long forced = 0;
+
+	public:
+
+		void configure(unsigned newRatio, double newTolerance) {
+			ratio = std::max(newRatio, 1u);
+			tolerance = std::max(newTolerance, 0.0);
+			clear();
+			anchors = extrapolated = forced = 0;
+		}
+
+		// The field changed
+		void clear(void) {
+			anchored = false;
+		}
+
+		bool isEnabled(void) const {
+			return ratio > 1;
+		}
+
+		// In s: the measured flat outputs at time t. True if the reference
+		//	is extrapolated to t, in s and d; false if the field must be
+		//	evaluated at s. At the time of the anchor: false, the memo has it
+		bool extrapolate(double t, double s[4], double d[4][4]) {
+
+			if (ratio <= 1 || !anchored || t <= t0) {
+				return false;
+			}
+			bool newStep = (t != last);
+			unsigned n = steps + (newStep ? 1 : 0);
+			if (n >= ratio) {
+				return false;
+			}
+
+			double h = t - t0;
+			double sRef[4], dRef[4][4];
+			double drift = 0;
+			for (unsigned i = 0; i < 4; ++i) {
+				// sum over n of D(k+n) h^n / n!, D0 = s0
+				const double c[5] = {s0[i], d0[0][i], d0[1][i], d0[2][i], d0[3][i]};
+				for (unsigned k = 0; k < 5; ++k) {
+					double v = 0, term = 1;
+					for (unsigned n = 0; k + n < 5; ++n) {
+						v += c[k+n] * term;
+						term *= h / (n + 1);
+					}
+					if (k == 0) {
+						sRef[i] = v;
+					} else {
+						dRef[k-1][i] = v;
+					}
+				}
+				double e = sRef[i] - s[i];
+				if (i == 3) {
+					e = std::remainder(e, 2 * M_PI);
+				}
+				drift = std::max(drift, std::fabs(e));
+			}
+			if (drift > tolerance) {
+				if (newStep) {
+					++forced;
+				}
+				return false;
+			}
+
+			if (newStep) {
+				steps = n;
+				last = t;
+				++extrapolated;
+			}
+			std::copy(sRef, sRef+4, s);
+			std::copy(&dRef[0][0], &dRef[0][0]+16, &d[0][0]);
+			return true;
+		}
+
+		// The field was evaluated at s, at time t
+		void anchor(double t, const double s[4], const double d[4][4]) {
+			t0 = last = t;
+			std::copy(s, s+4, s0);
+			std::copy(&d[0][0], &d[0][0]+16, &d0[0][0]);
+			steps = 0;
+			anchored = true;
+			++anchors;
+		}
+
+		unsigned long long getAnchors(void) const {
+			return anchors;
+		}
+
+		unsigned long long getExtrapolated(void) const {
+			return extrapolated;
+		}
+
+		unsigned long long getForced(void) const {
+			return forced;
+		}
+};
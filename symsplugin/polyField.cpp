@@ -0,0 +1,235 @@
+
+#include <algorithm>
+#include "polyField.hpp"
+
+using namespace GiNaC;
+using std::vector;
+
+
+// x^n for small integers n
+static inline double ipow(double x, unsigned n) {
+
+	double r = 1;
+	while (n) {
+		if (n & 1) r *= x;
+		x *= x;
+		n >>= 1;
+	}
+	return r;
+}
+
+
+// Recursive extraction of the coefficients of e, one variable at a time
+static bool collectTerms(const ex &e, const vector<symbol> &vars, unsigned var,
+		unsigned exps[4], vector<PolyTerm> &out) {
+
+	if (var == vars.size()) {
+		ex c = e.evalf();		// numeric constants like Pi
+		if (!is_a<numeric>(c) || !ex_to<numeric>(c).is_real()) {
+			return false;
+		}
+		PolyTerm t;
+		t.c = ex_to<numeric>(c).to_double();
+		std::copy(exps, exps+4, t.e);
+		if (t.c != 0) {
+			out.push_back(t);
+		}
+		return true;
+	}
+
+	int lo = e.ldegree(vars[var]);
+	int hi = e.degree(vars[var]);
+	for (int d = lo; d <= hi; ++d) {
+		exps[var] = d;
+		if (!collectTerms(e.coeff(vars[var], d), vars, var+1, exps, out)) {
+			return false;
+		}
+	}
+	exps[var] = 0;
+	return true;
+}
+
+
+bool PolyField::set(const ex &e, const vector<symbol> &vars) {
+
+	terms.clear();
+	nodes.clear();
+	entries.clear();
+	root = -1;
+
+	lst varsLst;
+	for (const symbol &v : vars) {
+		varsLst.append(v);
+	}
+	if (vars.size() > 4 || !e.is_polynomial(varsLst)) {
+		return false;
+	}
+
+	unsigned exps[4] = {0, 0, 0, 0};
+	if (!collectTerms(e.expand(), vars, 0, exps, terms)) {
+		terms.clear();
+		return false;
+	}
+
+	if (!terms.empty()) {
+		vector<PolyTerm> ts(terms);
+		root = build(ts, 0);
+	}
+	return true;
+}
+
+
+// Builds the Horner node of the terms ts (which share all the exponents
+//	before var) and returns its index
+int PolyField::build(vector<PolyTerm> &ts, unsigned var) {
+
+	// Decreasing degree in var
+	std::sort(ts.begin(), ts.end(), [var](const PolyTerm &a, const PolyTerm &b) {
+			return a.e[var] > b.e[var]; });
+
+	// Variables that do not appear are skipped
+	if (var < 3 && ts.front().e[var] == 0) {
+		return build(ts, var+1);
+	}
+
+	// Children first: the entries of one node must be contiguous
+	vector<Entry> nodeEntries;
+	auto first = ts.begin();
+	while (first != ts.end()) {
+		auto last = std::find_if(first, ts.end(), [&](const PolyTerm &t) {
+				return t.e[var] != first->e[var]; });
+
+		Entry en;
+		en.deg = first->e[var];
+		if (var == 3) {
+			en.child = -1;
+			en.c = first->c;		// terms are unique after collectTerms
+		} else {
+			vector<PolyTerm> group(first, last);
+			en.child = build(group, var+1);
+			en.c = 0;
+		}
+		nodeEntries.push_back(en);
+		first = last;
+	}
+
+	Node node;
+	node.var = var;
+	node.begin = entries.size();
+	entries.insert(entries.end(), nodeEntries.begin(), nodeEntries.end());
+	node.end = entries.size();
+	nodes.push_back(node);
+
+	return nodes.size() - 1;
+}
+
+
+double PolyField::evalNode(int n, const double s[4]) const {
+
+	const Node &node = nodes[n];
+	const double x = s[node.var];
+
+	double acc = 0;
+	unsigned prev = entries[node.begin].deg;
+	for (unsigned k = node.begin; k < node.end; ++k) {
+		const Entry &en = entries[k];
+		acc *= ipow(x, prev - en.deg);
+		acc += (en.child < 0) ? en.c : evalNode(en.child, s);
+		prev = en.deg;
+	}
+	return acc * ipow(x, prev);
+}
+
+
+unsigned PolyField::degree(void) const {
+
+	unsigned deg = 0;
+	for (const PolyTerm &t : terms) {
+		deg = std::max(deg, t.e[0] + t.e[1] + t.e[2] + t.e[3]);
+	}
+	return deg;
+}
+
+
+bool PolyDerivatives::set(const vector<symbol> &vars,
+		const vector<const matrix*> &derivs) {
+
+	clear();
+
+	for (unsigned k = 0; k < 4; ++k) {
+		for (unsigned i = 0; i < 4; ++i) {
+			if (!D[k][i].set((*derivs.at(k))(i,0), vars)) {
+				return false;
+			}
+		}
+	}
+
+	// Affine fields
+	linear = true;
+	for (unsigned i = 0; i < 4; ++i) {
+		linear = linear && (D[0][i].degree() <= 1);
+	}
+
+	if (linear) {
+		double A[4][4] = {};
+		for (unsigned i = 0; i < 4; ++i) {
+			b[i] = 0;
+			for (const PolyTerm &t : D[0][i].getTerms()) {
+				unsigned j = std::find(t.e, t.e+4, 1u) - t.e;
+				if (j == 4) {
+					b[i] += t.c;
+				} else {
+					A[i][j] += t.c;
+				}
+			}
+		}
+
+		// Powers of A
+		for (unsigned k = 0; k < 3; ++k) {
+			for (unsigned r = 0; r < 4; ++r) {
+				for (unsigned c = 0; c < 4; ++c) {
+					if (k == 0) {
+						Apow[k][r][c] = A[r][c];
+						continue;
+					}
+					Apow[k][r][c] = 0;
+					for (unsigned j = 0; j < 4; ++j) {
+						Apow[k][r][c] += A[r][j] * Apow[k-1][j][c];
+					}
+				}
+			}
+		}
+	}
+
+	enabled = true;
+	return true;
+}
+
+
+void PolyDerivatives::eval(const double s[4], double d[4][4]) const {
+
+	if (!linear) {
+		for (unsigned k = 0; k < 4; ++k) {
+			for (unsigned i = 0; i < 4; ++i) {
+				d[k][i] = D[k][i].eval(s);
+			}
+		}
+		return;
+	}
+
+	// Constant matrix power series: D(k+1) = A^k * D1
+	for (unsigned i = 0; i < 4; ++i) {
+		d[0][i] = b[i];
+		for (unsigned j = 0; j < 4; ++j) {
+			d[0][i] += Apow[0][i][j] * s[j];
+		}
+	}
+	for (unsigned k = 1; k < 4; ++k) {
+		for (unsigned i = 0; i < 4; ++i) {
+			d[k][i] = 0;
+			for (unsigned j = 0; j < 4; ++j) {
+				d[k][i] += Apow[k-1][i][j] * d[0][j];
+			}
+		}
+	}
+}
@@ -0,0 +1,91 @@
+// Polynomial fields: D1..D4 as sparse coefficient tables, evaluated in
+// doubles with multivariate Horner. Affine fields use Dk = A^(k-1) * D1
+
+#pragma once
+
+#include <vector>
+#include <ginac/ginac.h>
+
+
+// One monomial: c * x^e[0] * y^e[1] * z^e[2] * w^e[3]
+struct PolyTerm {
+	double c;
+	unsigned e[4];
+};
+
+
+class PolyField {
+
+	private:
+		// Horner scheme, one node for each (variable, partial monomial):
+		//	node = sum_k var^deg_k * child_k, children sorted by decreasing degree
+		struct Entry {
+			unsigned deg;
+			int child;			// node index, -1 for the constant leaf
+			double c;			// leaf value, only if child == -1
+		};
+		struct Node {
+			unsigned var;
+			unsigned begin, end;	// entries range
+		};
+
+		std::vector<PolyTerm> terms;
+		int root = -1;
+		std::vector<Node> nodes;
+		std::vector<Entry> entries;
+
+		int build(std::vector<PolyTerm> &ts, unsigned var);
+		double evalNode(int node, const double s[4]) const;
+
+	public:
+
+		// Fill the coefficient table; false if e is not a polynomial in vars
+		bool set(const GiNaC::ex &e, const std::vector<GiNaC::symbol> &vars);
+
+		double eval(const double s[4]) const {
+			return (root < 0) ? 0 : evalNode(root, s);
+		}
+
+		const std::vector<PolyTerm>& getTerms(void) const {
+			return terms;
+		}
+
+		// Max total degree of the monomials
+		unsigned degree(void) const;
+};
+
+
+class PolyDerivatives {
+
+	private:
+		bool enabled = false;
+		bool linear = false;
+
+		PolyField D[4][4];			// [order-1][component]
+
+		// Affine field: D1 = A*s + b, A^1, A^2, A^3 for D2, D3, D4
+		double b[4];
+		double Apow[3][4][4];
+
+	public:
+
+		// From the symbolic derivatives D1..D4 (4x1 matrices)
+		bool set(const std::vector<GiNaC::symbol> &vars,
+				const std::vector<const GiNaC::matrix*> &derivs);
+
+		// d[k][i] is the component i of the derivative of order k+1 at s
+		void eval(const double s[4], double d[4][4]) const;
+
+		void clear(void) {
+			enabled = false;
+			linear = false;
+		}
+
+		bool isEnabled(void) const {
+			return enabled;
+		}
+
+		bool isLinear(void) const {
+			return linear;
+		}
+};
@@ -0,0 +1,194 @@
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fieldSampler.hpp"
+#include "poseBatch.hpp"
+
+using std::vector;
+using std::string;
+
+
+static const unsigned CHUNK = 1 << 16;		// poses per chunk
+static const unsigned LINE_SIZE = BATCH_OUT_SIZE * 26;	// max CSV line
+
+
+static void evalChunk(const double *poses, unsigned n, double *out,
+		const PoseEval &eval, bool parallel) {
+
+	auto job = [&](unsigned first, unsigned last) {
+		for (unsigned p = first; p < last; ++p) {
+			eval(poses + p*BATCH_POSE_SIZE, out + p*BATCH_OUT_SIZE);
+		}
+	};
+	if (parallel) {
+		parallelFor(n, job);
+	} else {
+		job(0, n);
+	}
+}
+
+
+// Formats the lines in parallel, then writes them in order
+static void writeCsv(const double *out, unsigned n, vector<char> &text) {
+
+	text.resize((size_t)n * LINE_SIZE);
+	vector<unsigned> length(n);
+
+	parallelFor(n, [&](unsigned first, unsigned last) {
+		for (unsigned p = first; p < last; ++p) {
+			char *line = &text[(size_t)p * LINE_SIZE];
+			unsigned len = 0;
+			for (unsigned i = 0; i < BATCH_OUT_SIZE; ++i) {
+				len += snprintf(line + len, LINE_SIZE - len, i ? ",%.17g" : "%.17g",
+						out[p*BATCH_OUT_SIZE + i]);
+			}
+			line[len++] = '\n';
+			length[p] = len;
+		}
+	});
+
+	for (unsigned p = 0; p < n; ++p) {
+		fwrite(&text[(size_t)p * LINE_SIZE], 1, length[p], stdout);
+	}
+}
+
+
+// Reads up to 6 numbers separated by commas, spaces or tabs; false if the
+//	line doesn't have them
+static bool parsePose(const string &line, double pose[BATCH_POSE_SIZE]) {
+
+	const char *c = line.c_str();
+	for (unsigned i = 0; i < BATCH_POSE_SIZE; ++i) {
+		while (*c == ',' || *c == ' ' || *c == '\t' || *c == ';') {
+			++c;
+		}
+		char *end;
+		pose[i] = strtod(c, &end);
+		if (end == c) {
+			return false;
+		}
+		c = end;
+	}
+	return true;
+}
+
+
+static long long csvBatch(std::istream &in, const PoseEval &eval, bool parallel,
+		std::ostream &err) {
+
+	vector<double> poses, out;
+	vector<char> text;
+	poses.reserve(CHUNK * BATCH_POSE_SIZE);
+	long long total = 0;
+	unsigned long lineNum = 0;
+	string line;
+
+	printf("fz,tx,ty,tz,x,y,z,vx,vy,vz,a,b,g,p,q,r\n");
+
+	auto flush = [&]() {
+		unsigned n = poses.size() / BATCH_POSE_SIZE;
+		out.resize((size_t)n * BATCH_OUT_SIZE);
+		evalChunk(poses.data(), n, out.data(), eval, parallel);
+		writeCsv(out.data(), n, text);
+		total += n;
+		poses.clear();
+	};
+
+	while (std::getline(in, line)) {
+		++lineNum;
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		double pose[BATCH_POSE_SIZE];
+		if (!parsePose(line, pose)) {
+			if (lineNum == 1) {
+				continue;		// header
+			}
+			err << "Line " << lineNum << ": expected x, y, z, a, b, g\n";
+			return -1;
+		}
+		poses.insert(poses.end(), pose, pose + BATCH_POSE_SIZE);
+		if (poses.size() == CHUNK * BATCH_POSE_SIZE) {
+			flush();
+		}
+	}
+	flush();
+	return total;
+}
+
+
+static long long binaryBatch(const string &poseFile, const PoseEval &eval,
+		bool parallel, std::ostream &err) {
+
+	int fd = open(poseFile.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		err << "Can't open " << poseFile << std::endl;
+		if (fd >= 0) close(fd);
+		return -1;
+	}
+	if (st.st_size % (BATCH_POSE_SIZE * sizeof(double)) != 0) {
+		err << poseFile << ": not a sequence of " << BATCH_POSE_SIZE << " doubles\n";
+		close(fd);
+		return -1;
+	}
+	long long total = st.st_size / (BATCH_POSE_SIZE * sizeof(double));
+	if (total == 0) {
+		close(fd);
+		return 0;
+	}
+
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		err << "Can't map " << poseFile << std::endl;
+		return -1;
+	}
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	const double *poses = (const double *)map;
+	vector<double> out((size_t)CHUNK * BATCH_OUT_SIZE);
+	for (long long first = 0; first < total; first += CHUNK) {
+		unsigned n = std::min<long long>(CHUNK, total - first);
+		evalChunk(poses + first*BATCH_POSE_SIZE, n, out.data(), eval, parallel);
+		fwrite(out.data(), sizeof(double), (size_t)n * BATCH_OUT_SIZE, stdout);
+	}
+
+	munmap(map, st.st_size);
+	return total;
+}
+
+
+long long runPoseBatch(const string &poseFile, const PoseEval &eval, bool parallel,
+		std::ostream &err) {
+
+	static char outBuffer[1 << 20];
+	setvbuf(stdout, outBuffer, _IOFBF, sizeof(outBuffer));
+
+	long long n;
+	if (poseFile == "-") {
+		std::ios::sync_with_stdio(false);
+		n = csvBatch(std::cin, eval, parallel, err);
+	} else if (poseFile.size() > 4 && poseFile.substr(poseFile.size() - 4) == ".bin") {
+		n = binaryBatch(poseFile, eval, parallel, err);
+	} else {
+		std::ifstream file(poseFile);
+		if (!file) {
+			err << "Can't open " << poseFile << std::endl;
+			return -1;
+		}
+		n = csvBatch(file, eval, parallel, err);
+	}
+
+	fflush(stdout);
+	return n;
+}
@@ -0,0 +1,23 @@
+// Offline evaluation of logged poses (x, y, z, a, b, g, vrep convention)
+// from CSV or a memory-mapped .bin of 6 doubles per pose. Writes, in the same
+// format, fz, tx, ty, tz and the state: x, y, z, vx, vy, vz, a, b, g, p, q, r
+
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <functional>
+
+
+enum {
+	BATCH_POSE_SIZE = 6,		// doubles in a pose
+	BATCH_OUT_SIZE = 16,		// doubles in a result
+};
+
+typedef std::function<void(const double pose[BATCH_POSE_SIZE],
+		double out[BATCH_OUT_SIZE])> PoseEval;
+
+
+// poseFile "-" is stdin. Returns the number of poses, -1 on errors
+long long runPoseBatch(const std::string &poseFile, const PoseEval &eval,
+		bool parallel, std::ostream &err);
@@ -0,0 +1,93 @@
+// Precision tiers of the runtime evaluation: float (Taylor series of the
+// tape in floats), double (numeric backends) and exact (GiNaC). The shadow
+// mode evaluates a fraction of the steps at the next tier
+
+#pragma once
+
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+
+enum PrecisionTier {
+	TIER_FLOAT, TIER_DOUBLE, TIER_EXACT
+};
+
+
+// Backends of a step at a tier: field derivatives and flatness map
+enum DerivBackend {
+	DERIVS_FLOAT_TAPE, DERIVS_ATLAS, DERIVS_KERNEL, DERIVS_POLY, DERIVS_GAUSS,
+	DERIVS_TAPE, DERIVS_SYMBOLIC
+};
+
+enum MapBackend {
+	MAP_EXACT, MAP_KERNEL, MAP_NUMERIC, MAP_SYMBOLIC
+};
+
+inline const char *backendName(DerivBackend backend) {
+	static const char *names[] = {"tape (float)", "atlas", "kernel", "poly", "gauss",
+		"tape", "symbolic"};
+	return names[backend];
+}
+
+inline const char *backendName(MapBackend backend) {
+	static const char *names[] = {"exact symbolic", "kernel", "numeric", "symbolic"};
+	return names[backend];
+}
+
+
+inline bool parsePrecisionTier(const std::string &name, PrecisionTier &tier) {
+
+	if (name == "float") tier = TIER_FLOAT;
+	else if (name == "double") tier = TIER_DOUBLE;
+	else if (name == "exact") tier = TIER_EXACT;
+	else return false;
+	return true;
+}
+
+
+struct ShadowStats {
+
+	double fraction = 0;		// of the steps evaluated twice
+	double credit = 0;			// accumulates fraction, one shadow step per unit
+
+	unsigned long long samples = 0;
+	double maxRelError = 0;
+	unsigned long long worstStep = 0;
+
+	void reset(double newFraction) {
+		fraction = std::min(std::max(newFraction, 0.0), 1.0);
+		credit = 0;
+		samples = 0;
+		maxRelError = 0;
+		worstStep = 0;
+	}
+
+	// True if this step should be evaluated again
+	bool due(void) {
+		credit += fraction;
+		if (credit < 1) {
+			return false;
+		}
+		credit -= 1;
+		return true;
+	}
+
+	// Relative errors of n values against the reference; true on a new max
+	bool add(const double *values, const double *reference, unsigned n,
+			unsigned long long step) {
+
+		double err = 0;
+		for (unsigned i = 0; i < n; ++i) {
+			double scale = std::max(std::fabs(reference[i]), 1e-9);
+			err = std::max(err, std::fabs(values[i] - reference[i]) / scale);
+		}
+		++samples;
+		if (err > maxRelError) {
+			maxRelError = err;
+			worstStep = step;
+			return true;
+		}
+		return false;
+	}
+};
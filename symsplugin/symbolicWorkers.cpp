@@ -0,0 +1,148 @@
+
+#include <sstream>
+#include <string>
+#include <cerrno>
+#include <csignal>
+#include <algorithm>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include "symbolicWorkers.hpp"
+
+using std::vector;
+using std::string;
+using namespace GiNaC;
+
+
+// In the child: runs the task, writes the archive and exits
+static void runChild(const SymbolicTask &task, int fd) {
+
+	int status = 1;
+	try {
+		exvector res = task();
+		archive ar;
+		for (const ex &e : res) {
+			ar.archive_ex(e, "e");
+		}
+		std::ostringstream os;
+		os << ar;
+		const string data = os.str();
+
+		size_t done = 0;
+		while (done < data.size()) {
+			ssize_t n = write(fd, data.data() + done, data.size() - done);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) break;
+			done += n;
+		}
+		status = (done == data.size()) ? 0 : 1;
+	} catch (...) {
+	}
+	close(fd);
+	_exit(status);		// no destructors or atexit handlers of the parent
+}
+
+
+bool runSymbolicTasks(const vector<SymbolicTask> &tasks, const lst &syms,
+		unsigned workers, vector<exvector> &results,
+		const std::function<void(unsigned)> &done) {
+
+	struct Worker {
+		unsigned task;
+		pid_t pid;
+		int fd;
+		string data;
+	};
+
+	results.assign(tasks.size(), exvector());
+	workers = std::max(1u, workers);
+	vector<Worker> running;
+	unsigned next = 0, finished = 0;
+	bool ok = true;
+
+	while (ok && (next < tasks.size() || !running.empty())) {
+
+		// Start new workers
+		while (ok && next < tasks.size() && running.size() < workers) {
+			int fds[2];
+			if (pipe(fds) != 0) {
+				ok = false;
+				break;
+			}
+			pid_t pid = fork();
+			if (pid < 0) {
+				close(fds[0]);
+				close(fds[1]);
+				ok = false;
+				break;
+			}
+			if (pid == 0) {
+				close(fds[0]);
+				runChild(tasks[next], fds[1]);
+			}
+			close(fds[1]);
+			running.push_back({next++, pid, fds[0], string()});
+		}
+		if (running.empty()) {
+			break;
+		}
+
+		// Read from all the pipes, or a full pipe would block its child
+		vector<pollfd> polls;
+		for (const Worker &w : running) {
+			polls.push_back({w.fd, POLLIN, 0});
+		}
+		if (poll(polls.data(), polls.size(), -1) < 0) {
+			if (errno == EINTR) continue;
+			ok = false;
+			break;
+		}
+
+		for (size_t i = running.size(); i-- > 0; ) {
+			if (!polls[i].revents) {
+				continue;
+			}
+			Worker &w = running[i];
+			char buffer[65536];
+			ssize_t n = read(w.fd, buffer, sizeof(buffer));
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			if (n > 0) {
+				w.data.append(buffer, n);
+				continue;
+			}
+
+			// End of the data: unarchive the results
+			close(w.fd);
+			int status;
+			waitpid(w.pid, &status, 0);
+			if (n < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				ok = false;
+			} else {
+				try {
+					std::istringstream is(w.data);
+					archive ar;
+					is >> ar;
+					for (unsigned k = 0; k < ar.num_expressions(); ++k) {
+						results[w.task].push_back(ar.unarchive_ex(syms, k));
+					}
+				} catch (std::exception &e) {
+					ok = false;
+				}
+			}
+			running.erase(running.begin() + i);
+			if (ok && done) {
+				done(++finished);
+			}
+		}
+	}
+
+	// On errors: stop the other workers
+	for (const Worker &w : running) {
+		kill(w.pid, SIGKILL);
+		close(w.fd);
+		waitpid(w.pid, NULL, 0);
+	}
+	return ok;
+}
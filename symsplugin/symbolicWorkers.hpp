@@ -0,0 +1,19 @@
+// Symbolic computations in forked worker processes, since GiNaC is not
+// thread-safe: each task runs in a child, that inherits the expressions, and
+// returns its results as a GiNaC archive. On failure, compute sequentially
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <ginac/ginac.h>
+
+
+typedef std::function<GiNaC::exvector(void)> SymbolicTask;
+
+
+// syms: the symbols in the results, unarchived by name as these objects;
+//	done(n), if set, after each task, with the number of tasks done
+bool runSymbolicTasks(const std::vector<SymbolicTask> &tasks, const GiNaC::lst &syms,
+		unsigned workers, std::vector<GiNaC::exvector> &results,
+		const std::function<void(unsigned)> &done = nullptr);
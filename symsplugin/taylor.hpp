@@ -0,0 +1,227 @@
+// Truncated Taylor series up to the 4th order: c[k] = f^(k)(t0) / k!. The
+// operations give the exact derivatives of compositions; the result must not
+// alias an argument. Taylor is in double precision, TaylorF in float
+
+#pragma once
+
+#include <cmath>
+
+
+#define TAYLOR_SIZE 5		// orders 0..4
+
+
+template <class T>
+struct TaylorT {
+	T c[TAYLOR_SIZE];
+};
+
+typedef TaylorT<double> Taylor;
+typedef TaylorT<float> TaylorF;
+
+
+template <class T>
+inline void tConst(double v, TaylorT<T> &r, unsigned n) {
+	r.c[0] = v;
+	for (unsigned k = 1; k <= n; ++k) r.c[k] = 0;
+}
+
+template <class T>
+inline void tAdd(const TaylorT<T> &a, const TaylorT<T> &b, TaylorT<T> &r, unsigned n) {
+	for (unsigned k = 0; k <= n; ++k) r.c[k] = a.c[k] + b.c[k];
+}
+
+template <class T>
+inline void tSub(const TaylorT<T> &a, const TaylorT<T> &b, TaylorT<T> &r, unsigned n) {
+	for (unsigned k = 0; k <= n; ++k) r.c[k] = a.c[k] - b.c[k];
+}
+
+template <class T>
+inline void tScale(const TaylorT<T> &a, double s, TaylorT<T> &r, unsigned n) {
+	for (unsigned k = 0; k <= n; ++k) r.c[k] = T(s) * a.c[k];
+}
+
+template <class T>
+inline void tMul(const TaylorT<T> &a, const TaylorT<T> &b, TaylorT<T> &r, unsigned n) {
+	for (unsigned k = 0; k <= n; ++k) {
+		T s = 0;
+		for (unsigned j = 0; j <= k; ++j) s += a.c[j] * b.c[k-j];
+		r.c[k] = s;
+	}
+}
+
+template <class T>
+inline void tDiv(const TaylorT<T> &a, const TaylorT<T> &b, TaylorT<T> &r, unsigned n) {
+	for (unsigned k = 0; k <= n; ++k) {
+		T s = a.c[k];
+		for (unsigned j = 0; j < k; ++j) s -= r.c[j] * b.c[k-j];
+		r.c[k] = s / b.c[0];
+	}
+}
+
+template <class T>
+inline void tExp(const TaylorT<T> &a, TaylorT<T> &r, unsigned n) {
+	r.c[0] = std::exp(a.c[0]);
+	for (unsigned k = 1; k <= n; ++k) {
+		T s = 0;
+		for (unsigned j = 1; j <= k; ++j) s += j * a.c[j] * r.c[k-j];
+		r.c[k] = s / k;
+	}
+}
+
+template <class T>
+inline void tLog(const TaylorT<T> &a, TaylorT<T> &r, unsigned n) {
+	r.c[0] = std::log(a.c[0]);
+	for (unsigned k = 1; k <= n; ++k) {
+		T s = 0;
+		for (unsigned j = 1; j < k; ++j) s += j * r.c[j] * a.c[k-j];
+		r.c[k] = (a.c[k] - s / k) / a.c[0];
+	}
+}
+
+// a^p, p real; a.c[0] != 0
+template <class T>
+inline void tPowR(const TaylorT<T> &a, double p, TaylorT<T> &r, unsigned n) {
+	r.c[0] = std::pow(a.c[0], p);
+	for (unsigned k = 1; k <= n; ++k) {
+		T s = 0;
+		for (unsigned j = 1; j <= k; ++j) s += T((p + 1) * j - k) * a.c[j] * r.c[k-j];
+		r.c[k] = s / (k * a.c[0]);
+	}
+}
+
+// a^p, p integer, also for a.c[0] == 0
+template <class T>
+inline void tPowI(const TaylorT<T> &a, int p, TaylorT<T> &r, unsigned n) {
+
+	TaylorT<T> base = a, acc, tmp;
+	tConst(1, acc, n);
+	for (unsigned e = (p < 0) ? -p : p; e; e >>= 1) {
+		if (e & 1) {
+			tMul(acc, base, tmp, n);
+			acc = tmp;
+		}
+		tMul(base, base, tmp, n);
+		base = tmp;
+	}
+
+	if (p < 0) {
+		TaylorT<T> one;
+		tConst(1, one, n);
+		tDiv(one, acc, r, n);
+	} else {
+		r = acc;
+	}
+}
+
+template <class T>
+inline void tSinCos(const TaylorT<T> &a, TaylorT<T> &s, TaylorT<T> &c, unsigned n) {
+	s.c[0] = std::sin(a.c[0]);
+	c.c[0] = std::cos(a.c[0]);
+	for (unsigned k = 1; k <= n; ++k) {
+		T ss = 0, cc = 0;
+		for (unsigned j = 1; j <= k; ++j) {
+			ss += j * a.c[j] * c.c[k-j];
+			cc -= j * a.c[j] * s.c[k-j];
+		}
+		s.c[k] = ss / k;
+		c.c[k] = cc / k;
+	}
+}
+
+template <class T>
+inline void tSinhCosh(const TaylorT<T> &a, TaylorT<T> &s, TaylorT<T> &c, unsigned n) {
+	s.c[0] = std::sinh(a.c[0]);
+	c.c[0] = std::cosh(a.c[0]);
+	for (unsigned k = 1; k <= n; ++k) {
+		T ss = 0, cc = 0;
+		for (unsigned j = 1; j <= k; ++j) {
+			ss += j * a.c[j] * c.c[k-j];
+			cc += j * a.c[j] * s.c[k-j];
+		}
+		s.c[k] = ss / k;
+		c.c[k] = cc / k;
+	}
+}
+
+// r' = a' / q: the integral of a'/q, r.c[0] given
+template <class T>
+inline void tIntegrate(const TaylorT<T> &a, const TaylorT<T> &q, TaylorT<T> &r, unsigned n) {
+	for (unsigned k = 1; k <= n; ++k) {
+		T s = k * a.c[k];
+		for (unsigned j = 1; j < k; ++j) s -= j * r.c[j] * q.c[k-j];
+		r.c[k] = s / (k * q.c[0]);
+	}
+}
+
+template <class T>
+inline void tAtan(const TaylorT<T> &a, TaylorT<T> &r, unsigned n) {
+	TaylorT<T> q;
+	tMul(a, a, q, n);
+	q.c[0] += 1;
+	r.c[0] = std::atan(a.c[0]);
+	tIntegrate(a, q, r, n);
+}
+
+template <class T>
+inline void tAsin(const TaylorT<T> &a, TaylorT<T> &r, unsigned n) {
+	TaylorT<T> a2, q;
+	tMul(a, a, a2, n);
+	tScale(a2, -1, a2, n);
+	a2.c[0] += 1;
+	tPowR(a2, 0.5, q, n);
+	r.c[0] = std::asin(a.c[0]);
+	tIntegrate(a, q, r, n);
+}
+
+template <class T>
+inline void tAcos(const TaylorT<T> &a, TaylorT<T> &r, unsigned n) {
+	tAsin(a, r, n);
+	tScale(r, -1, r, n);
+	r.c[0] = std::acos(a.c[0]);
+}
+
+template <class T>
+inline void tAtan2(const TaylorT<T> &y, const TaylorT<T> &x, TaylorT<T> &r, unsigned n) {
+
+	// atan(y/x) or -atan(x/y), plus a constant
+	TaylorT<T> ratio;
+	if (std::fabs(x.c[0]) >= std::fabs(y.c[0])) {
+		tDiv(y, x, ratio, n);
+		tAtan(ratio, r, n);
+	} else {
+		tDiv(x, y, ratio, n);
+		tAtan(ratio, r, n);
+		tScale(r, -1, r, n);
+	}
+	r.c[0] = std::atan2(y.c[0], x.c[0]);
+}
+
+template <class T>
+inline void tAbs(const TaylorT<T> &a, TaylorT<T> &r, unsigned n) {
+	tScale(a, (a.c[0] < 0) ? -1 : 1, r, n);
+}
+
+
+// Derivatives 1..4 of s(t) along the flow s' = V(s), s(0) = s0:
+//	field(S, V, k) computes the coefficients 0..k of V on the series S.
+//	d[k][i] is the component i of the derivative of order k+1. The series
+//	are in T precision
+template <class T = double, class F>
+void tFlowDerivatives(const double s0[4], double d[4][4], F field) {
+
+	TaylorT<T> S[4], V[4];
+	for (unsigned i = 0; i < 4; ++i) {
+		tConst(s0[i], S[i], TAYLOR_SIZE-1);
+	}
+
+	// The coefficient k of V only needs the coefficients 0..k of S
+	double factorial = 1;
+	for (unsigned k = 0; k < 4; ++k) {
+		field(S, V, k);
+		factorial *= k + 1;
+		for (unsigned i = 0; i < 4; ++i) {
+			S[i].c[k+1] = V[i].c[k] / (k + 1);
+			d[k][i] = factorial * S[i].c[k+1];
+		}
+	}
+}
@@ -0,0 +1,79 @@
+
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include "telemetry.hpp"
+
+
+bool Telemetry::start(const std::string &filePath) {
+
+	stop();
+
+	file = fopen(filePath.c_str(), "wb");
+	if (!file) {
+		std::cerr << "Telemetry: can't open " << filePath << std::endl;
+		return false;
+	}
+
+	TelemetryHeader header;
+	std::copy(TELEMETRY_MAGIC, TELEMETRY_MAGIC+4, header.magic);
+	header.version = TELEMETRY_VERSION;
+	header.recordSize = sizeof(TelemetryRecord);
+	fwrite(&header, sizeof(header), 1, file);
+
+	ring.resize(CAPACITY);
+	head.store(0);
+	tail.store(0);
+	dropped = 0;
+
+	running.store(true);
+	writer = std::thread(&Telemetry::writerLoop, this);
+
+	return true;
+}
+
+
+void Telemetry::stop(void) {
+
+	if (!running.load()) {
+		return;
+	}
+
+	running.store(false);
+	writer.join();
+
+	flush();
+	fclose(file);
+	file = NULL;
+
+	if (dropped > 0) {
+		std::cerr << "Telemetry: " << dropped << " records dropped" << std::endl;
+	}
+}
+
+
+void Telemetry::writerLoop(void) {
+
+	while (running.load()) {
+		flush();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+}
+
+
+void Telemetry::flush(void) {
+
+	uint64_t h = head.load(std::memory_order_acquire);
+	uint64_t t = tail.load(std::memory_order_relaxed);
+
+	// At most two contiguous chunks
+	while (t != h) {
+		uint64_t begin = t & (CAPACITY-1);
+		uint64_t n = std::min(h - t, CAPACITY - begin);
+		fwrite(&ring[begin], sizeof(TelemetryRecord), n, file);
+		t += n;
+	}
+
+	tail.store(t, std::memory_order_release);
+	fflush(file);
+}
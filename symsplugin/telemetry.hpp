@@ -0,0 +1,87 @@
+// Per-step telemetry: the control loop fills a lock-free ring buffer, a
+// background thread writes it to a binary log (TelemetryHeader, then raw
+// TelemetryRecords). Read it with ./telemetryReader log.bin > log.csv
+
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+
+#define TELEMETRY_MAGIC "FFTL"
+#define TELEMETRY_VERSION 1
+
+
+struct TelemetryHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t recordSize;
+};
+
+
+struct TelemetryRecord {
+	uint64_t step;			// number of updateState calls
+	double time;			// [s] since the log start
+	double evalTime;		// [s] spent in updateState
+	double pose[6];			// measured x, y, z, a, b, g (vrep)
+	double flat[5][4];		// flat outputs and derivatives D1..D4 (paper)
+	double state[12];		// desired State
+	double inputs[4];		// fz, tx, ty, tz
+};
+
+
+class Telemetry {
+
+	private:
+		static const unsigned CAPACITY = 4096;		// records, power of 2
+
+		std::vector<TelemetryRecord> ring;
+		std::atomic<uint64_t> head;				// written by the producer
+		std::atomic<uint64_t> tail;				// written by the writer thread
+		std::atomic<bool> running;
+		uint64_t dropped = 0;
+
+		std::thread writer;
+		FILE *file = NULL;
+
+		void writerLoop(void);
+		void flush(void);
+
+	public:
+
+		Telemetry(): head(0), tail(0), running(false) {}
+		~Telemetry() {
+			stop();
+		}
+
+		bool start(const std::string &filePath);
+		void stop(void);
+
+		bool isRunning(void) const {
+			return running.load(std::memory_order_relaxed);
+		}
+
+		// Producer side: the free slot, or NULL if the buffer is full
+		TelemetryRecord* beginRecord(void) {
+			uint64_t h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) >= CAPACITY) {
+				++dropped;
+				return NULL;
+			}
+			return &ring[h & (CAPACITY-1)];
+		}
+
+		// Publish the slot returned by beginRecord()
+		void commitRecord(void) {
+			head.store(head.load(std::memory_order_relaxed) + 1,
+					std::memory_order_release);
+		}
+
+		uint64_t getDropped(void) const {
+			return dropped;
+		}
+};
@@ -0,0 +1,57 @@
+
+// Converts a binary telemetry log (see telemetry.hpp) to CSV on stdout
+
+#include <cstring>
+#include <iostream>
+#include "telemetry.hpp"
+
+using namespace std;
+
+
+int main(int argc, char *argv[]) {
+
+	if (argc != 2) {
+		cerr << "Usage: " << argv[0] << " telemetryLog\n";
+		return 1;
+	}
+
+	FILE *file = fopen(argv[1], "rb");
+	if (!file) {
+		cerr << "Can't open " << argv[1] << endl;
+		return 1;
+	}
+
+	TelemetryHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+			strncmp(header.magic, TELEMETRY_MAGIC, 4) != 0 ||
+			header.version != TELEMETRY_VERSION ||
+			header.recordSize != sizeof(TelemetryRecord)) {
+		cerr << "Not a telemetry log of this version\n";
+		fclose(file);
+		return 1;
+	}
+
+	cout << "step,time,evalTime,x,y,z,a,b,g";
+	for (unsigned n = 0; n < 5; ++n) {
+		for (const char *v : {"x", "y", "z", "w"}) {
+			cout << ",D" << n << v;
+		}
+	}
+	cout << ",sx,sy,sz,svx,svy,svz,sa,sb,sg,sp,sq,sr,fz,tx,ty,tz\n";
+
+	cout.precision(10);
+	TelemetryRecord r;
+	while (fread(&r, sizeof(r), 1, file) == 1) {
+		cout << r.step << "," << r.time << "," << r.evalTime;
+		for (double v : r.pose) cout << "," << v;
+		for (unsigned n = 0; n < 5; ++n) {
+			for (double v : r.flat[n]) cout << "," << v;
+		}
+		for (double v : r.state) cout << "," << v;
+		for (double v : r.inputs) cout << "," << v;
+		cout << "\n";
+	}
+
+	fclose(file);
+	return 0;
+}
@@ -0,0 +1,179 @@
+
+// Headless driver: loads the plugin with the stand-in V-REP library
+//	(vrepStandIn.cpp) from the current directory, and calls the script
+//	functions as a Lua script would. Measures each simExtFieldFollow_update
+//	call, stack marshalling included:
+//		./vrepDriver fieldFile steps [plugin.so]
+
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <dlfcn.h>
+#include "v_repTypes.h"
+#include "v_repConst.h"
+
+using namespace std;
+
+
+// Functions of the stand-in library and of the plugin
+struct {
+	simInt (*createStack)();
+	simInt (*releaseStack)(simInt);
+	simInt (*pushString)(simInt, const simChar*, simInt);
+	simInt (*pushDouble)(simInt, simDouble);
+	simInt (*pushDoubleTable)(simInt, const simDouble*, simInt);
+	simInt (*getStackSize)(simInt);
+	simInt (*moveToTop)(simInt, simInt);
+	simInt (*getDouble)(simInt, simDouble*);
+	simInt (*getBool)(simInt, simBool*);
+	simInt (*popItem)(simInt, simInt);
+	simInt (*getObjectHandle)(const simChar*);
+	simInt (*getObjectMatrix)(simInt, simInt, simFloat*);
+	simInt (*setObjectMatrix)(simInt, simInt, const simFloat*);
+	simInt (*getEulerAngles)(const simFloat*, simFloat*);
+	simInt (*call)(const simChar*, simInt);
+
+	unsigned char (*start)(void*, int);
+	void (*end)();
+	void* (*message)(int, int*, void*, int*);
+} api;
+
+
+template <class F>
+static bool bind(void *lib, const char *name, F &f) {
+	f = (F)dlsym(lib, name);
+	if (!f) {
+		cerr << "Missing " << name << endl;
+	}
+	return f != NULL;
+}
+
+
+// Return values of a call: numbers and bools, bottom to top
+static vector<double> popResults(int stack) {
+	vector<double> out;
+	while (api.getStackSize(stack) > 0) {
+		api.moveToTop(stack, 0);
+		double v = 0;
+		simBool b;
+		if (api.getDouble(stack, &v) != 1 && api.getBool(stack, &b) == 1) {
+			v = b;
+		}
+		out.push_back(v);
+		api.popItem(stack, 1);
+	}
+	return out;
+}
+
+
+static void message(int msg) {
+	int aux[4] = {0, 0, 0, 0}, reply[4] = {-1, -1, -1, -1};
+	api.message(msg, aux, NULL, reply);
+}
+
+
+int main(int argc, char *argv[]) {
+
+	if (argc != 3 && argc != 4) {
+		cerr << "Usage: " << argv[0] << " fieldFile steps [plugin.so]\n";
+		return 1;
+	}
+	string field = argv[1];
+	unsigned steps = atoi(argv[2]);
+	string plugin = (argc == 4) ? argv[3] : "./libv_repExtFieldFollow.so";
+
+	// The plugin loads libv_rep.so from the current directory: the same
+	//	library instance
+	void *vrep = dlopen("./libv_rep.so", RTLD_NOW);
+	void *lib = dlopen(plugin.c_str(), RTLD_NOW);
+	if (!vrep || !lib) {
+		cerr << dlerror() << endl;
+		return 1;
+	}
+	bool ok = bind(vrep, "simCreateStack", api.createStack) &&
+		bind(vrep, "simReleaseStack", api.releaseStack) &&
+		bind(vrep, "simPushStringOntoStack", api.pushString) &&
+		bind(vrep, "simPushDoubleOntoStack", api.pushDouble) &&
+		bind(vrep, "simPushDoubleTableOntoStack", api.pushDoubleTable) &&
+		bind(vrep, "simGetStackSize", api.getStackSize) &&
+		bind(vrep, "simMoveStackItemToTop", api.moveToTop) &&
+		bind(vrep, "simGetStackDoubleValue", api.getDouble) &&
+		bind(vrep, "simGetStackBoolValue", api.getBool) &&
+		bind(vrep, "simPopStackItem", api.popItem) &&
+		bind(vrep, "simGetObjectHandle", api.getObjectHandle) &&
+		bind(vrep, "simGetObjectMatrix", api.getObjectMatrix) &&
+		bind(vrep, "simSetObjectMatrix", api.setObjectMatrix) &&
+		bind(vrep, "simGetEulerAnglesFromMatrix", api.getEulerAngles) &&
+		bind(vrep, "standInCallScriptFunction", api.call) &&
+		bind(lib, "v_repStart", api.start) &&
+		bind(lib, "v_repEnd", api.end) &&
+		bind(lib, "v_repMessage", api.message);
+	if (!ok || !api.start(NULL, 0)) {
+		return 1;
+	}
+
+	// The quadcopter shape at (1, 0, 1), as in the executable
+	int quad = api.getObjectHandle("Quadricopter");
+	const simFloat pose0[12] = {1,0,0,1, 0,1,0,0, 0,0,1,1};
+	api.setObjectMatrix(quad, -1, pose0);
+
+	// simExtFieldFollow_init(field, shape, mass, inertia)
+	int stack = api.createStack();
+	const double inertia[9] = {0.006, 0, 0, 0, 0.006, 0, 0, 0, 0.011};
+	api.pushString(stack, field.c_str(), field.size());
+	api.pushString(stack, "Quadricopter", 12);
+	api.pushDouble(stack, 0.87);
+	api.pushDoubleTable(stack, inertia, 9);
+	api.call("simExtFieldFollow_init", stack);
+	vector<double> res = popResults(stack);
+	if (res.empty() || res[0] == 0) {
+		cerr << "simExtFieldFollow_init failed\n";
+		return 1;
+	}
+
+	// Poses on a small circle around the initial pose, set by init
+	simFloat m[12], abgF[3];
+	api.getObjectMatrix(quad, -1, m);
+	api.getEulerAngles(m, abgF);
+	const double abg[3] = {abgF[0], abgF[1], abgF[2]};
+
+	message(sim_message_eventcallback_simulationabouttostart);
+
+	vector<double> micros(steps);
+	for (unsigned k = 0; k < steps; ++k) {
+		double phase = 2 * M_PI * k / max(steps, 1u);
+		const double xyz[3] = {m[3] + 0.1*cos(phase), m[7] + 0.1*sin(phase), m[11]};
+
+		auto t0 = chrono::steady_clock::now();
+		api.pushDoubleTable(stack, xyz, 3);
+		api.pushDoubleTable(stack, abg, 3);
+		api.call("simExtFieldFollow_update", stack);
+		res = popResults(stack);
+		micros[k] = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+	}
+
+	message(sim_message_eventcallback_simulationended);
+	api.releaseStack(stack);
+	api.end();
+
+	if (steps > 0) {
+		double total = 0;
+		for (double t : micros) {
+			total += t;
+		}
+		sort(micros.begin(), micros.end());
+		cout << steps << " updates: mean " << total / steps << " us, p50 " <<
+			micros[steps/2] << " us, p99 " << micros[steps*99/100] << " us, max " <<
+			micros.back() << " us\n";
+		cout << "last inputs [fz, tx, ty, tz]:";
+		for (double v : res) {
+			cout << " " << v;
+		}
+		cout << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,536 @@
+
+// Stand-in for libv_rep.so, to run the plugin without V-REP: the script
+//	stack, objects poses, parameters and drawing objects are kept in memory.
+//	The other functions are in vrepStandInStubs.cpp. Build with make standin,
+//	and see vrepDriver.cpp
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include "v_repTypes.h"
+#include "v_repConst.h"
+
+using std::string;
+using std::vector;
+
+#define STANDIN_API extern "C" __attribute__((visibility("default")))
+
+
+/***
+ * Script stack
+ ***/
+struct StackValue {
+	enum Type {NIL, BOOL, NUMBER, STRING, TABLE} type = NIL;
+	bool b = false;
+	double number = 0;
+	string str;
+	vector<StackValue> keys, values;		// tables
+};
+
+static std::map<int, vector<StackValue>> stacks;
+static int nextStack = 1;
+
+static vector<StackValue> *getStack(int h) {
+	auto it = stacks.find(h);
+	return (it == stacks.end()) ? NULL : &it->second;
+}
+
+static StackValue *top(int h) {
+	vector<StackValue> *s = getStack(h);
+	return (s && !s->empty()) ? &s->back() : NULL;
+}
+
+static int push(int h, const StackValue &v) {
+	vector<StackValue> *s = getStack(h);
+	if (!s) {
+		return -1;
+	}
+	s->push_back(v);
+	return 1;
+}
+
+static StackValue numberValue(double n) {
+	StackValue v;
+	v.type = StackValue::NUMBER;
+	v.number = n;
+	return v;
+}
+
+// Lua array: keys 1..n, in order
+static bool isArray(const StackValue &t) {
+	for (size_t i = 0; i < t.keys.size(); ++i) {
+		if (t.keys[i].type != StackValue::NUMBER || t.keys[i].number != i+1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template <class T>
+static int pushTable(int h, const T *values, int n) {
+	StackValue t;
+	t.type = StackValue::TABLE;
+	for (int i = 0; i < n; ++i) {
+		t.keys.push_back(numberValue(i+1));
+		t.values.push_back(numberValue(values[i]));
+	}
+	return push(h, t);
+}
+
+template <class T>
+static int getTable(int h, T *array, int count) {
+	StackValue *t = top(h);
+	if (!t || t->type != StackValue::TABLE) {
+		return -1;
+	}
+	bool allNumbers = true;
+	for (int i = 0; i < count; ++i) {
+		bool isNumber = (i < (int)t->values.size() && t->values[i].type == StackValue::NUMBER);
+		array[i] = isNumber ? (T)t->values[i].number : 0;
+		allNumbers = allNumbers && isNumber;
+	}
+	return allNumbers ? 1 : 0;
+}
+
+template <class T>
+static int getNumber(int h, T *value) {
+	StackValue *v = top(h);
+	if (!v) {
+		return -1;
+	}
+	if (v->type != StackValue::NUMBER) {
+		return 0;
+	}
+	*value = (T)v->number;
+	return 1;
+}
+
+
+STANDIN_API simInt simCreateStack() {
+	stacks[nextStack];
+	return nextStack++;
+}
+
+STANDIN_API simInt simReleaseStack(simInt stackHandle) {
+	return stacks.erase(stackHandle) ? 1 : -1;
+}
+
+STANDIN_API simInt simPushNullOntoStack(simInt stackHandle) {
+	return push(stackHandle, StackValue());
+}
+
+STANDIN_API simInt simPushBoolOntoStack(simInt stackHandle, simBool value) {
+	StackValue v;
+	v.type = StackValue::BOOL;
+	v.b = (value != 0);
+	return push(stackHandle, v);
+}
+
+STANDIN_API simInt simPushInt32OntoStack(simInt stackHandle, simInt value) {
+	return push(stackHandle, numberValue(value));
+}
+
+STANDIN_API simInt simPushFloatOntoStack(simInt stackHandle, simFloat value) {
+	return push(stackHandle, numberValue(value));
+}
+
+STANDIN_API simInt simPushDoubleOntoStack(simInt stackHandle, simDouble value) {
+	return push(stackHandle, numberValue(value));
+}
+
+STANDIN_API simInt simPushStringOntoStack(simInt stackHandle, const simChar *value,
+		simInt stringSize) {
+	StackValue v;
+	v.type = StackValue::STRING;
+	v.str.assign(value, stringSize);
+	return push(stackHandle, v);
+}
+
+STANDIN_API simInt simPushUInt8TableOntoStack(simInt stackHandle, const simUChar *values,
+		simInt valueCnt) {
+	return pushTable(stackHandle, values, valueCnt);
+}
+
+STANDIN_API simInt simPushInt32TableOntoStack(simInt stackHandle, const simInt *values,
+		simInt valueCnt) {
+	return pushTable(stackHandle, values, valueCnt);
+}
+
+STANDIN_API simInt simPushFloatTableOntoStack(simInt stackHandle, const simFloat *values,
+		simInt valueCnt) {
+	return pushTable(stackHandle, values, valueCnt);
+}
+
+STANDIN_API simInt simPushDoubleTableOntoStack(simInt stackHandle, const simDouble *values,
+		simInt valueCnt) {
+	return pushTable(stackHandle, values, valueCnt);
+}
+
+STANDIN_API simInt simPushTableOntoStack(simInt stackHandle) {
+	StackValue v;
+	v.type = StackValue::TABLE;
+	return push(stackHandle, v);
+}
+
+// Stack: ..., table, key, value
+STANDIN_API simInt simInsertDataIntoStackTable(simInt stackHandle) {
+	vector<StackValue> *s = getStack(stackHandle);
+	if (!s || s->size() < 3 || (*s)[s->size()-3].type != StackValue::TABLE) {
+		return -1;
+	}
+	StackValue &t = (*s)[s->size()-3];
+	t.keys.push_back((*s)[s->size()-2]);
+	t.values.push_back((*s)[s->size()-1]);
+	s->resize(s->size()-2);
+	return 1;
+}
+
+STANDIN_API simInt simGetStackSize(simInt stackHandle) {
+	vector<StackValue> *s = getStack(stackHandle);
+	return s ? (simInt)s->size() : -1;
+}
+
+// count 0: all
+STANDIN_API simInt simPopStackItem(simInt stackHandle, simInt count) {
+	vector<StackValue> *s = getStack(stackHandle);
+	if (!s) {
+		return -1;
+	}
+	size_t n = (count == 0) ? s->size() : std::min(s->size(), (size_t)count);
+	s->resize(s->size() - n);
+	return s->size();
+}
+
+STANDIN_API simInt simMoveStackItemToTop(simInt stackHandle, simInt cIndex) {
+	vector<StackValue> *s = getStack(stackHandle);
+	if (!s || cIndex < 0 || cIndex >= (simInt)s->size()) {
+		return -1;
+	}
+	StackValue v = (*s)[cIndex];
+	s->erase(s->begin() + cIndex);
+	s->push_back(v);
+	return 1;
+}
+
+STANDIN_API simInt simIsStackValueNull(simInt stackHandle) {
+	StackValue *v = top(stackHandle);
+	return v ? (v->type == StackValue::NIL) : -1;
+}
+
+STANDIN_API simInt simGetStackBoolValue(simInt stackHandle, simBool *boolValue) {
+	StackValue *v = top(stackHandle);
+	if (!v) {
+		return -1;
+	}
+	if (v->type != StackValue::BOOL) {
+		return 0;
+	}
+	*boolValue = v->b;
+	return 1;
+}
+
+STANDIN_API simInt simGetStackInt32Value(simInt stackHandle, simInt *numberValue) {
+	return getNumber(stackHandle, numberValue);
+}
+
+STANDIN_API simInt simGetStackFloatValue(simInt stackHandle, simFloat *numberValue) {
+	return getNumber(stackHandle, numberValue);
+}
+
+STANDIN_API simInt simGetStackDoubleValue(simInt stackHandle, simDouble *numberValue) {
+	return getNumber(stackHandle, numberValue);
+}
+
+// Released with simReleaseBuffer
+STANDIN_API simChar *simGetStackStringValue(simInt stackHandle, simInt *stringSize) {
+	StackValue *v = top(stackHandle);
+	if (!v || v->type != StackValue::STRING) {
+		return NULL;
+	}
+	simChar *buffer = new simChar[v->str.size() + 1];
+	memcpy(buffer, v->str.c_str(), v->str.size() + 1);
+	if (stringSize) {
+		*stringSize = v->str.size();
+	}
+	return buffer;
+}
+
+// infoType 0: array size, or sim_stack_table_*; 1..4: 1 if all values are
+//	nil, numbers, bools or strings
+STANDIN_API simInt simGetStackTableInfo(simInt stackHandle, simInt infoType) {
+	StackValue *t = top(stackHandle);
+	if (!t) {
+		return -1;
+	}
+	if (t->type != StackValue::TABLE) {
+		return sim_stack_table_not_table;
+	}
+	if (infoType == 0) {
+		if (t->keys.empty()) {
+			return sim_stack_table_empty;
+		}
+		return isArray(*t) ? (simInt)t->values.size() : sim_stack_table_map;
+	}
+	const StackValue::Type expected[] = {StackValue::NIL, StackValue::NIL,
+		StackValue::NUMBER, StackValue::BOOL, StackValue::STRING};
+	if (infoType > 4) {
+		return -1;
+	}
+	for (const StackValue &v : t->values) {
+		if (v.type != expected[infoType]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+STANDIN_API simInt simGetStackUInt8Table(simInt stackHandle, simUChar *array, simInt count) {
+	return getTable(stackHandle, array, count);
+}
+
+STANDIN_API simInt simGetStackInt32Table(simInt stackHandle, simInt *array, simInt count) {
+	return getTable(stackHandle, array, count);
+}
+
+STANDIN_API simInt simGetStackFloatTable(simInt stackHandle, simFloat *array, simInt count) {
+	return getTable(stackHandle, array, count);
+}
+
+STANDIN_API simInt simGetStackDoubleTable(simInt stackHandle, simDouble *array, simInt count) {
+	return getTable(stackHandle, array, count);
+}
+
+// Replaces the table with its key, value pairs
+STANDIN_API simInt simUnfoldStackTable(simInt stackHandle) {
+	vector<StackValue> *s = getStack(stackHandle);
+	if (!s || s->empty() || s->back().type != StackValue::TABLE) {
+		return -1;
+	}
+	StackValue t = s->back();
+	s->pop_back();
+	for (size_t i = 0; i < t.keys.size(); ++i) {
+		s->push_back(t.keys[i]);
+		s->push_back(t.values[i]);
+	}
+	return 1;
+}
+
+STANDIN_API simInt simReleaseBuffer(simChar *buffer) {
+	delete[] buffer;
+	return 1;
+}
+
+
+/***
+ * Script functions
+ ***/
+static std::map<string, simVoid(*)(SScriptCallBack*)> scriptFunctions;
+
+// "name@plugin": registered as name
+STANDIN_API simInt simRegisterScriptCallbackFunction(const simChar *funcNameAtPluginName,
+		const simChar *callTips, simVoid(*callBack)(SScriptCallBack *cb)) {
+	string name(funcNameAtPluginName);
+	scriptFunctions[name.substr(0, name.find('@'))] = callBack;
+	return 1;
+}
+
+STANDIN_API simInt simSetLastError(const simChar *funcName, const simChar *errorMessage) {
+	std::cerr << funcName << ": " << errorMessage << std::endl;
+	return 1;
+}
+
+// Calls a registered function as a script would: arguments on the stack,
+//	replaced by the return values. -1 if the function is not registered
+STANDIN_API simInt standInCallScriptFunction(const simChar *name, simInt stackHandle) {
+	auto it = scriptFunctions.find(name);
+	if (it == scriptFunctions.end() || !getStack(stackHandle)) {
+		return -1;
+	}
+	SScriptCallBack cb = {-1, -1, stackHandle, 0, NULL};
+	it->second(&cb);
+	return 1;
+}
+
+
+/***
+ * Parameters
+ ***/
+static std::map<int, int> intParameters = {
+	{sim_intparam_program_version, 30400},
+	{sim_intparam_error_report_mode, sim_api_errormessage_output},
+};
+
+STANDIN_API simInt simGetIntegerParameter(simInt parameter, simInt *intState) {
+	*intState = intParameters[parameter];
+	return 1;
+}
+
+STANDIN_API simInt simSetIntegerParameter(simInt parameter, simInt intState) {
+	intParameters[parameter] = intState;
+	return 1;
+}
+
+
+/***
+ * Objects: created on the first simGetObjectHandle, at the origin. Poses are
+ *	absolute, relativeToObjectHandle is ignored
+ ***/
+struct StandInObject {
+	string name;
+	simFloat m[12];			// 3x4, row major
+	std::map<int, simFloat> floatParameters;
+};
+
+static vector<StandInObject> objects;
+
+static StandInObject *getObject(int h) {
+	return (h >= 0 && h < (int)objects.size()) ? &objects[h] : NULL;
+}
+
+// R = Rx(a) Ry(b) Rz(g), the vrep Euler angles
+static void eulerToMatrix(const simFloat e[3], simFloat m[12]) {
+	double ca = cos(e[0]), sa = sin(e[0]), cb = cos(e[1]), sb = sin(e[1]),
+		   cg = cos(e[2]), sg = sin(e[2]);
+	m[0] = cb*cg;				m[1] = -cb*sg;				m[2] = sb;
+	m[4] = ca*sg + sa*sb*cg;	m[5] = ca*cg - sa*sb*sg;	m[6] = -sa*cb;
+	m[8] = sa*sg - ca*sb*cg;	m[9] = sa*cg + ca*sb*sg;	m[10] = ca*cb;
+}
+
+STANDIN_API simInt simGetObjectHandle(const simChar *objectName) {
+	for (size_t h = 0; h < objects.size(); ++h) {
+		if (objects[h].name == objectName) {
+			return h;
+		}
+	}
+	StandInObject o;
+	o.name = objectName;
+	const simFloat identity[12] = {1,0,0,0, 0,1,0,0, 0,0,1,0};
+	memcpy(o.m, identity, sizeof(o.m));
+	objects.push_back(o);
+	return objects.size() - 1;
+}
+
+STANDIN_API simInt simGetObjectMatrix(simInt objectHandle, simInt relativeToObjectHandle,
+		simFloat *matrix) {
+	StandInObject *o = getObject(objectHandle);
+	if (!o) {
+		return -1;
+	}
+	memcpy(matrix, o->m, sizeof(o->m));
+	return 1;
+}
+
+STANDIN_API simInt simSetObjectMatrix(simInt objectHandle, simInt relativeToObjectHandle,
+		const simFloat *matrix) {
+	StandInObject *o = getObject(objectHandle);
+	if (!o) {
+		return -1;
+	}
+	memcpy(o->m, matrix, sizeof(o->m));
+	return 1;
+}
+
+STANDIN_API simInt simSetObjectPosition(simInt objectHandle, simInt relativeToObjectHandle,
+		const simFloat *position) {
+	StandInObject *o = getObject(objectHandle);
+	if (!o) {
+		return -1;
+	}
+	o->m[3] = position[0];
+	o->m[7] = position[1];
+	o->m[11] = position[2];
+	return 1;
+}
+
+STANDIN_API simInt simSetObjectOrientation(simInt objectHandle, simInt relativeToObjectHandle,
+		const simFloat *eulerAngles) {
+	StandInObject *o = getObject(objectHandle);
+	if (!o) {
+		return -1;
+	}
+	eulerToMatrix(eulerAngles, o->m);
+	return 1;
+}
+
+STANDIN_API simInt simGetEulerAnglesFromMatrix(const simFloat *matrix, simFloat *eulerAngles) {
+	eulerAngles[0] = atan2(-matrix[6], matrix[10]);
+	eulerAngles[1] = asin(std::max(-1.0f, std::min(1.0f, matrix[2])));
+	eulerAngles[2] = atan2(-matrix[1], matrix[0]);
+	return 1;
+}
+
+// Axis (absolute) and angle of the rotation from matrixStart to matrixGoal
+STANDIN_API simInt simGetRotationAxis(const simFloat *matrixStart, const simFloat *matrixGoal,
+		simFloat *axis, simFloat *angle) {
+	double r[3][3];			// goal * start^T
+	for (unsigned i = 0; i < 3; ++i) {
+		for (unsigned j = 0; j < 3; ++j) {
+			r[i][j] = 0;
+			for (unsigned k = 0; k < 3; ++k) {
+				r[i][j] += matrixGoal[i*4+k] * matrixStart[j*4+k];
+			}
+		}
+	}
+	double v[3] = {r[2][1] - r[1][2], r[0][2] - r[2][0], r[1][0] - r[0][1]};
+	double s = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+	*angle = atan2(s / 2, (r[0][0] + r[1][1] + r[2][2] - 1) / 2);
+	for (unsigned i = 0; i < 3; ++i) {
+		axis[i] = (s > 1e-12) ? v[i] / s : (i == 2);
+	}
+	return 1;
+}
+
+STANDIN_API simInt simGetObjectVelocity(simInt objectHandle, simFloat *linearVelocity,
+		simFloat *angularVelocity) {
+	for (unsigned i = 0; i < 3; ++i) {
+		linearVelocity[i] = 0;
+		angularVelocity[i] = 0;
+	}
+	return getObject(objectHandle) ? 1 : -1;
+}
+
+STANDIN_API simInt simResetDynamicObject(simInt objectHandle) {
+	return getObject(objectHandle) ? 1 : -1;
+}
+
+STANDIN_API simInt simSetObjectFloatParameter(simInt objectHandle, simInt parameterID,
+		simFloat parameter) {
+	StandInObject *o = getObject(objectHandle);
+	if (!o) {
+		return -1;
+	}
+	o->floatParameters[parameterID] = parameter;
+	return 1;
+}
+
+
+/***
+ * Drawing objects: only the number of items
+ ***/
+static std::map<int, int> drawingObjects;
+static int nextDrawingObject = 1;
+
+STANDIN_API simInt simAddDrawingObject(simInt objectType, simFloat size,
+		simFloat duplicateTolerance, simInt parentObjectHandle, simInt maxItemCount,
+		const simFloat *ambient_diffuse, const simFloat *setToNULL,
+		const simFloat *specular, const simFloat *emission) {
+	drawingObjects[nextDrawingObject] = 0;
+	return nextDrawingObject++;
+}
+
+STANDIN_API simInt simAddDrawingObjectItem(simInt objectHandle, const simFloat *itemData) {
+	auto it = drawingObjects.find(objectHandle);
+	if (it == drawingObjects.end()) {
+		return -1;
+	}
+	it->second = itemData ? it->second + 1 : 0;		// NULL: clear
+	return 1;
+}
+
+STANDIN_API simInt simRemoveDrawingObject(simInt objectHandle) {
+	return drawingObjects.erase(objectHandle) ? 1 : -1;
+}
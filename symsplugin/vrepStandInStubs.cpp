@@ -0,0 +1,9 @@
+
+// The V-REP functions not implemented by vrepStandIn.cpp. The plugin checks
+//	that all the functions of the library exist, but doesn't call these.
+//	vrepStandInStubs.inc is generated from v_repLib.cpp by the makefile
+
+#define VREP_STUB(name) \
+	extern "C" __attribute__((weak, visibility("default"))) int name(void) { return -1; }
+
+#include "vrepStandInStubs.inc"